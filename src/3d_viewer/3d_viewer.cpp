@@ -3,16 +3,29 @@
 #include <GLFW/glfw3.h>
 #include <stb_image.h>
 
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <filesystem>
+#include <functional>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <memory>
 
+#include "alloc_counter.h"
+#include "clustered_scheme.h"
 #include "config.h"
+#include "deferred_scheme.h"
+#include "file_watcher.h"
+#include "gl_ext.h"
+#include "gl_state.h"
 #include "model.h"
 #include "navigate.h"
+#include "point_shadow_scheme.h"
 #include "rendering_scheme.h"
 #include "shader.h"
+#include "visibility_scheme.h"
 
 #define SCR_WIDTH 800
 #define SCR_HEIGHT 600
@@ -64,10 +77,48 @@ GLFWwindow *InitWindowOpenGL() {
     glfwTerminate();
     return NULL;
   }
+  LoadGLExtensions((GLADloadproc)glfwGetProcAddress);
+  ObjectModel::ResetInstanceAttributes();
+  // the default viewport covers the whole framebuffer
+  int width, height;
+  glfwGetFramebufferSize(window, &width, &height);
+  GLState::Instance().Viewport(0, 0, width, height);
   return window;
 }
 
 SceneModel CreateTestModel();
+SceneModel CreateStressModel(unsigned int cube_num);
+// light_count point and spot lights spread over the scene box
+std::vector<Light> CreateSceneLights(const RenderingScheme &scheme,
+                                     unsigned int light_count);
+
+void PrintUsage(const char *exe) {
+  std::cerr
+      << "usage: " << exe << " [options]\n"
+      << "  --stress N: N instanced cubes instead of the model\n"
+      << "  --shadow-filter pcf|hardware|poisson|evsm: shadow edge filtering\n"
+      << "  --shadow-benchmark: GPU time of each shadow filter, then quit\n"
+      << "  --depth-prepass: lay down depth before the lit pass\n"
+      << "  --prepass-benchmark: GPU time with and without the depth prepass\n"
+      << "    and front-to-back sorting, then quit\n"
+      << "  --scheme shadow|point-shadow|deferred|clustered|visibility:\n"
+      << "    directional or point light with shadows, many point and spot\n"
+      << "    lights by deferred or clustered forward shading, or a\n"
+      << "    visibility buffer for dense meshes\n"
+      << "  --lights N: lights of the deferred and clustered schemes\n"
+      << "  --lights-benchmark: time per frame with 1 to 4096 lights, then "
+         "quit"
+      << std::endl;
+}
+
+// a whole decimal number, false for anything else
+bool ParseCount(const char *s, unsigned int &count) {
+  char *end = nullptr;
+  unsigned long n = std::strtoul(s, &end, 10);
+  if (end == s || *end != '\0' || *s == '-' || n > 0xFFFFFFFFul) return false;
+  count = static_cast<unsigned int>(n);
+  return true;
+}
 
 int main(int argc, char **argv) {
   Config &config = Config::Instance();
@@ -78,8 +129,38 @@ int main(int argc, char **argv) {
   config.exe_dir = exe_dir.string();
   config.resource_dir = resource_path.string();
   config.shader_dir = shader_path.string();
+  auto shader_cache_path = exe_dir / "shader_cache";
+  std::error_code ec;
+  std::filesystem::create_directories(shader_cache_path, ec);
+  if (!ec) config.shader_cache_dir = shader_cache_path.string();
   std::string model_file_path =
       (resource_path / "backpack" / "backpack.obj").string();
+  // options, see PrintUsage
+  std::string scheme_name = "shadow";
+  unsigned int light_count = 256;
+  bool lights_benchmark = false;
+  unsigned int stress_cubes = 0;
+  std::string shadow_filter;
+  bool shadow_benchmark = false;
+  bool depth_prepass = false;
+  bool prepass_benchmark = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--shadow-benchmark") shadow_benchmark = true;
+    if (arg == "--depth-prepass") depth_prepass = true;
+    if (arg == "--prepass-benchmark") prepass_benchmark = true;
+    if (arg == "--lights-benchmark") lights_benchmark = true;
+    if (i + 1 == argc) continue;
+    if ((arg == "--stress" && !ParseCount(argv[i + 1], stress_cubes)) ||
+        (arg == "--lights" && !ParseCount(argv[i + 1], light_count))) {
+      std::cerr << arg << " expects a count, got " << argv[i + 1]
+                << std::endl;
+      PrintUsage(argv[0]);
+      return -1;
+    }
+    if (arg == "--shadow-filter") shadow_filter = argv[i + 1];
+    if (arg == "--scheme") scheme_name = argv[i + 1];
+  }
 
   // init GLFW window and OpenGL context
   GLFWwindow *window = InitWindowOpenGL();
@@ -87,17 +168,107 @@ int main(int argc, char **argv) {
 
   /* set up data and rendering scheme */
   navigation.camera().translate(glm::vec3(0.0f, 0.0f, 3.0f));
-  SceneModel model(model_file_path);
+  SceneModel model = stress_cubes > 0 ? CreateStressModel(stress_cubes)
+                                       : SceneModel(model_file_path);
   // Model model = CreateTestModel();
   // DirectionalLightingShadowScheme rendering_scheme;
   // rendering_scheme.SetModel(&model);
   // rendering_scheme.SetNavigation(&navigation);
   // rendering_scheme.SetLight(glm::vec3(-2.0f, 4.0f, -1.0f),
-  //                           -glm::vec3(-2.0f, 4.0f, -1.0f), 1.0, 7.5, 10.0);
+  //                           -glm::vec3(-2.0f, 4.0f, -1.0f));
   // SimpleRenderingScheme rendering_scheme(&model, &navigation);
-  DirectionalLightingShadowScheme rendering_scheme(&model, &navigation);
+  auto t0 = std::chrono::steady_clock::now();
+  // the options of a scheme are set through its own pointer
+  std::unique_ptr<RenderingScheme> rendering_scheme;
+  DirectionalLightingShadowScheme *shadow_scheme = nullptr;
+  DeferredRenderingScheme *deferred_scheme = nullptr;
+  ClusteredForwardScheme *clustered_scheme = nullptr;
+  PointLightShadowScheme *point_scheme = nullptr;
+  // sets the lights of the many-light schemes
+  std::function<void(unsigned int)> set_lights;
+  typedef DirectionalLightingShadowScheme::ShadowFilter ShadowFilter;
+  if (scheme_name == "deferred") {
+    deferred_scheme = new DeferredRenderingScheme(&model, &navigation);
+    rendering_scheme.reset(deferred_scheme);
+    set_lights = [deferred_scheme](unsigned int n) {
+      deferred_scheme->SetLights(CreateSceneLights(*deferred_scheme, n));
+    };
+  } else if (scheme_name == "clustered") {
+    clustered_scheme = new ClusteredForwardScheme(&model, &navigation);
+    rendering_scheme.reset(clustered_scheme);
+    set_lights = [clustered_scheme](unsigned int n) {
+      clustered_scheme->SetLights(CreateSceneLights(*clustered_scheme, n));
+    };
+  } else if (scheme_name == "point-shadow") {
+    point_scheme = new PointLightShadowScheme(&model, &navigation);
+    rendering_scheme.reset(point_scheme);
+  } else if (scheme_name == "visibility") {
+    rendering_scheme.reset(new VisibilityBufferScheme(&model, &navigation));
+  } else {
+    shadow_scheme = new DirectionalLightingShadowScheme(&model, &navigation);
+    rendering_scheme.reset(shadow_scheme);
+    for (int f = 0; f < DirectionalLightingShadowScheme::SHADOW_FILTER_NUM;
+         ++f)
+      if (shadow_filter == shadow_scheme->ShadowFilterName(ShadowFilter(f)))
+        shadow_scheme->SetShadowFilter(ShadowFilter(f));
+    shadow_scheme->SetDepthPrepass(depth_prepass);
+  }
+  if (set_lights) set_lights(light_count);
+  auto t1 = std::chrono::steady_clock::now();
+  std::cout << "rendering scheme ready in "
+            << std::chrono::duration<double, std::milli>(t1 - t0).count()
+            << " ms (program binary cache: "
+            << (GLExt().program_binary && !config.shader_cache_dir.empty()
+                    ? "on"
+                    : "off")
+            << ")" << std::endl;
+
+  // recompile shaders edited while the viewer runs
+  FileWatcher shader_watcher(config.shader_dir);
 
   // event loop
+  unsigned long frame_count = 0;
+  float first_frame = glfwGetTime();
+  unsigned long frame_allocs = 0, max_frame_allocs = 0;
+  unsigned long casters_drawn = 0, casters_culled = 0;
+  // cube shadow map renders, and the faces they drew
+  unsigned long cube_renders = 0, cube_faces = 0;
+  // clustered light assignment, over the whole run and the benchmark step
+  double assign_ms = 0.0, step_assign_ms = 0.0;
+  unsigned long light_references = 0, step_frames = 0;
+  // the benchmarks render each configuration for BENCHMARK_FRAMES frames,
+  // the shadow maps are redrawn every frame so that they are measured too
+  const unsigned long BENCHMARK_FRAMES = 300;
+  struct BenchmarkStep {
+    std::string name;
+    std::function<void()> apply;
+    // per timer of the scheme, then the CPU light assignment if clustered
+    std::vector<double> ms;
+  };
+  std::vector<BenchmarkStep> benchmark;
+  if (shadow_benchmark && shadow_scheme)
+    for (int f = 0; f < DirectionalLightingShadowScheme::SHADOW_FILTER_NUM;
+         ++f)
+      benchmark.push_back({shadow_scheme->ShadowFilterName(ShadowFilter(f)),
+                           [shadow_scheme, f] {
+                             shadow_scheme->SetShadowFilter(ShadowFilter(f));
+                           }});
+  if (prepass_benchmark && shadow_scheme)
+    for (int prepass = 0; prepass < 2; ++prepass)
+      for (int front_to_back = 0; front_to_back < 2; ++front_to_back)
+        benchmark.push_back(
+            {std::string(prepass ? "depth prepass" : "no prepass") +
+                 (front_to_back ? ", front-to-back" : ", state sorted"),
+             [shadow_scheme, prepass, front_to_back] {
+               shadow_scheme->SetDepthPrepass(prepass);
+               shadow_scheme->SetFrontToBack(front_to_back);
+             }});
+  if (lights_benchmark && set_lights)
+    for (unsigned int n = 1; n <= 4096; n *= 4)
+      benchmark.push_back({std::to_string(n) + " lights",
+                           [&set_lights, n] { set_lights(n); }});
+  unsigned int benchmark_step = 0;
+  GLState::Instance().ResetCounters();
   while (!glfwWindowShouldClose(window)) {
     // per frame time logic
     float current_frame = glfwGetTime();
@@ -105,15 +276,121 @@ int main(int argc, char **argv) {
     last_frame = current_frame;
     // process keyboard inputs
     process_keyboard_input(window);
+    // hot-reload edited shaders
+    for (const std::string &file : shader_watcher.TakeChanged())
+      rendering_scheme->ReloadShaders(file);
+    rendering_scheme->PollShaders();
+    // node transforms changed by the application reach the meshes here
+    model.UpdateTransforms();
+
+    if (!benchmark.empty() && frame_count % BENCHMARK_FRAMES == 0) {
+      if (frame_count > 0) {
+        std::vector<double> &ms = benchmark[benchmark_step++].ms;
+        for (auto &timer : rendering_scheme->Timers())
+          ms.push_back(timer.second->AverageMs());
+        if (clustered_scheme) ms.push_back(step_assign_ms / step_frames);
+      }
+      if (benchmark_step == benchmark.size()) break;
+      benchmark[benchmark_step].apply();
+      rendering_scheme->ResetTimers();
+      step_assign_ms = 0.0;
+      step_frames = 0;
+    }
+    if (!benchmark.empty() && shadow_scheme) shadow_scheme->InvalidateShadows();
 
     /* render */
-    rendering_scheme.Render();
+    unsigned long allocs = HeapAllocationCount();
+    rendering_scheme->Render();
+    frame_allocs = HeapAllocationCount() - allocs;
+    if (shadow_scheme) {
+      casters_drawn += shadow_scheme->GetShadowStats().drawn;
+      casters_culled += shadow_scheme->GetShadowStats().culled;
+    }
+    if (point_scheme) {
+      const PointLightShadowScheme::CubeStats &stats =
+          point_scheme->GetCubeStats();
+      if (stats.drawn + stats.culled > 0) ++cube_renders;
+      cube_faces += stats.faces;
+      casters_drawn += stats.drawn;
+      casters_culled += stats.culled;
+    }
+    if (clustered_scheme) {
+      const ClusteredForwardScheme::ClusterStats &stats =
+          clustered_scheme->GetClusterStats();
+      assign_ms += stats.assign_ms;
+      step_assign_ms += stats.assign_ms;
+      light_references += stats.references;
+    }
+    ++step_frames;
+    // the first frames fill caches, later ones should not allocate
+    if (frame_count > 0 && frame_allocs > max_frame_allocs)
+      max_frame_allocs = frame_allocs;
     // swap buffers and poll events
     glfwSwapBuffers(window);
     glfwPollEvents();
+    ++frame_count;
+  }
+
+  if (frame_count > 0)
+    std::cout << "average frame time: "
+              << 1000.0f * (last_frame - first_frame) / frame_count << " ms"
+              << std::endl;
+  // report how many state changes GLState saved
+  const GLState::Counters &counters = GLState::Instance().GetCounters();
+  if (frame_count > 0)
+    std::cout << "GL state calls per frame: issued "
+              << counters.issued / frame_count << ", elided "
+              << counters.elided / frame_count << std::endl;
+  if (cube_renders > 0)
+    std::cout << "cube shadow map rendered " << cube_renders << " times, "
+              << (float)cube_faces / cube_renders << " of 6 faces"
+              << ", mesh-face pairs drawn "
+              << (float)casters_drawn / cube_renders << ", culled "
+              << (float)casters_culled / cube_renders << std::endl;
+  if (frame_count > 0 && shadow_scheme)
+    std::cout << "shadow casters per frame: drawn "
+              << (float)casters_drawn / frame_count << ", culled "
+              << (float)casters_culled / frame_count << std::endl;
+  if (frame_count > 0 && clustered_scheme)
+    std::cout << "light assignment per frame: " << assign_ms / frame_count
+              << " ms on the CPU, " << light_references / frame_count
+              << " light references in "
+              << ClusteredForwardScheme::CLUSTER_X *
+                     ClusteredForwardScheme::CLUSTER_Y *
+                     ClusteredForwardScheme::CLUSTER_Z
+              << " clusters" << std::endl;
+  RenderingScheme::TimerList timers = rendering_scheme->Timers();
+  if (benchmark.empty() && !timers.empty()) {
+    std::cout << "GPU time per frame";
+    if (shadow_scheme)
+      std::cout << " ("
+                << shadow_scheme->ShadowFilterName(
+                       shadow_scheme->GetShadowFilter())
+                << " shadows)";
+    for (size_t i = 0; i < timers.size(); ++i)
+      std::cout << (i > 0 ? ", " : ": ") << timers[i].first << " "
+                << timers[i].second->AverageMs() << " ms";
+    std::cout << std::endl;
+  }
+  if (!benchmark.empty() && benchmark_step == benchmark.size()) {
+    std::cout << "GPU time per frame, in ms (";
+    for (size_t i = 0; i < timers.size(); ++i)
+      std::cout << (i > 0 ? ", " : "") << timers[i].first;
+    if (clustered_scheme) std::cout << ", CPU light assignment";
+    std::cout << "):" << std::endl;
+    for (const BenchmarkStep &step : benchmark) {
+      std::cout << "  " << step.name << ":";
+      for (size_t i = 0; i < step.ms.size(); ++i)
+        std::cout << (i > 0 ? ", " : " ") << step.ms[i];
+      std::cout << std::endl;
+    }
   }
+  if (frame_count > 1)
+    std::cout << "heap allocations per frame: last " << frame_allocs
+              << ", max after the first " << max_frame_allocs << std::endl;
 
   // end
+  rendering_scheme.reset();
   model.ReleaseBuffers();
   glfwTerminate();
   return 0;
@@ -124,50 +401,78 @@ SceneModel CreateTestModel() {
   Texture wood_tex;
   wood_tex.id = TextureFromFile("wood.png", Config::Instance().resource_dir);
   wood_tex.type = "texture_diffuse";
-
-  // create a mesh of standard cube
-  ObjectModel cube = ObjectModel::UnitCube();
-  cube.textures.push_back(wood_tex);
+  Material wood;
+  wood.textures[Material::DIFFUSE].push_back(wood_tex.id);
+  unsigned int wood_material = MaterialLibrary::Instance().Intern(wood);
 
   // Create model
   SceneModel model;
-  model.meshes.resize(4);
+  model.meshes.resize(2);
   model.textures_loaded.push_back(wood_tex);
-  //- add cube 0
-  model.meshes[0] = cube;
+  //- three instances of the standard cube
+  ObjectModel &cube = model.meshes[0];
+  cube = ObjectModel::UnitCube();
+  cube.material = wood_material;
+  const glm::vec3 cube_positions[3] = {glm::vec3(0.0f, 1.5f, 0.0),
+                                       glm::vec3(2.0f, 0.0f, 1.0),
+                                       glm::vec3(-1.0f, 0.0f, 2.0)};
   glm::mat4 M;
-  M = glm::mat4(1.0f);
-  M = glm::translate(M, glm::vec3(0.0f, 1.5f, 0.0));
-  M = glm::scale(M, glm::vec3(0.5f));
-  Transform(model.meshes[0].positions, model.meshes[0].normals, M);
-  model.meshes[0].LoadIntoBuffers();
-  //- add cube 1
-  model.meshes[1] = cube;
-  M = glm::mat4(1.0f);
-  M = glm::translate(M, glm::vec3(2.0f, 0.0f, 1.0));
-  M = glm::scale(M, glm::vec3(0.5f));
-  Transform(model.meshes[1].positions, model.meshes[1].normals, M);
-  model.meshes[1].LoadIntoBuffers();
-  //- add cube 2
-  model.meshes[2] = cube;
-  M = glm::mat4(1.0f);
-  M = glm::translate(M, glm::vec3(-1.0f, 0.0f, 2.0));
-  M = glm::scale(M, glm::vec3(0.5f));
-  Transform(model.meshes[2].positions, model.meshes[2].normals, M);
-  model.meshes[2].LoadIntoBuffers();
+  for (const glm::vec3 &p : cube_positions) {
+    M = glm::mat4(1.0f);
+    M = glm::translate(M, p);
+    M = glm::scale(M, glm::vec3(0.5f));
+    cube.AddInstance(M);
+  }
+  cube.LoadIntoBuffers();
   //- add a plane
-  ObjectModel &plane = model.meshes[3];
+  ObjectModel &plane = model.meshes[1];
   plane = ObjectModel::Quad(25.0f);
   M = glm::mat4(1.0f);
   M = glm::translate(M, glm::vec3(0.0f, -0.5f, 0.0f));
   M = glm::rotate(M, glm::radians(-90.0f), glm::vec3(1, 0, 0));
   Transform(plane.positions, plane.normals, M);
-  plane.textures.push_back(wood_tex);
+  plane.material = wood_material;
   plane.LoadIntoBuffers();
 
   return model;
 }
 
+SceneModel CreateStressModel(unsigned int cube_num) {
+  Texture wood_tex;
+  wood_tex.id = TextureFromFile("wood.png", Config::Instance().resource_dir);
+  wood_tex.type = "texture_diffuse";
+  Material wood;
+  wood.textures[Material::DIFFUSE].push_back(wood_tex.id);
+
+  SceneModel model;
+  model.textures_loaded.push_back(wood_tex);
+  model.meshes.resize(1);
+  ObjectModel &cube = model.meshes[0];
+  cube = ObjectModel::UnitCube();
+  cube.material = MaterialLibrary::Instance().Intern(wood);
+  // cubes on a grid, one draw call for all of them
+  unsigned int n = std::ceil(std::cbrt((float)cube_num));
+  for (unsigned int i = 0; i < cube_num; ++i) {
+    glm::vec3 p(i % n, (i / n) % n, i / (n * n));
+    glm::mat4 M(1.0f);
+    M = glm::translate(M, 3.0f * (p - 0.5f * float(n - 1)));
+    M = glm::rotate(M, 0.1f * i, glm::vec3(1.0f, 0.3f, 0.5f));
+    M = glm::scale(M, glm::vec3(0.5f));
+    cube.AddInstance(M);
+  }
+  cube.LoadIntoBuffers();
+  std::cout << cube_num << " instanced cubes" << std::endl;
+  return model;
+}
+
+std::vector<Light> CreateSceneLights(const RenderingScheme &scheme,
+                                     unsigned int light_count) {
+  glm::vec3 lo = scheme.BBoxMin(), hi = scheme.BBoxMax();
+  // a fixed radius, so the lit area grows with the light count
+  float radius = 0.2f * glm::length(hi - lo);
+  return ScatterLights(light_count, lo, hi, radius);
+}
+
 void process_keyboard_input(GLFWwindow *window) {
   if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     glfwSetWindowShouldClose(window, true);
@@ -183,7 +488,7 @@ void process_keyboard_input(GLFWwindow *window) {
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-  glViewport(0, 0, width, height);
+  GLState::Instance().Viewport(0, 0, width, height);
 }
 
 void cursor_pos_callback(GLFWwindow *window, double xpos, double ypos) {
@@ -0,0 +1,118 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+std::atomic<unsigned long> allocation_count(0);
+
+void *Allocate(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (size == 0) size = 1;
+  return std::malloc(size);
+}
+
+void *AllocateAligned(std::size_t size, std::align_val_t alignment) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  std::size_t a = static_cast<std::size_t>(alignment);
+  if (size == 0) size = 1;
+#ifdef _WIN32
+  return _aligned_malloc(size, a);
+#else
+  // aligned_alloc wants a multiple of the alignment
+  return std::aligned_alloc(a, (size + a - 1) / a * a);
+#endif
+}
+
+void FreeAligned(void *p) {
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+}  // namespace
+
+unsigned long HeapAllocationCount() {
+  return allocation_count.load(std::memory_order_relaxed);
+}
+
+// Every form is replaced: whether the array, nothrow and aligned forms of the
+// standard library forward to the plain ones is up to the implementation.
+void *operator new(std::size_t size) {
+  if (void *p = Allocate(size)) return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+  if (void *p = Allocate(size)) return p;
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  if (void *p = AllocateAligned(size, alignment)) return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  if (void *p = AllocateAligned(size, alignment)) return p;
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept { FreeAligned(p); }
+
+void operator delete[](void *p, std::align_val_t) noexcept { FreeAligned(p); }
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  FreeAligned(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  FreeAligned(p);
+}
+
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  FreeAligned(p);
+}
+
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  FreeAligned(p);
+}
@@ -0,0 +1,10 @@
+#ifndef _3D_VIEWER_ALLOC_COUNTER_H
+#define _3D_VIEWER_ALLOC_COUNTER_H
+
+/** Number of calls to the global operator new since program start, from all
+ * threads. Sample it around a frame to check that the steady-state render
+ * path does not allocate.
+ */
+unsigned long HeapAllocationCount();
+
+#endif  // _3D_VIEWER_ALLOC_COUNTER_H
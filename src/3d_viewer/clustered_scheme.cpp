@@ -0,0 +1,199 @@
+#include <glad/glad.h>
+
+#include "clustered_scheme.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <string>
+
+#include "config.h"
+#include "gl_state.h"
+#include "gl_util.h"
+
+static const std::string& res_dir() { return Config::Instance().shader_dir; }
+
+ClusteredForwardScheme::ClusteredForwardScheme()
+    : shader(res_dir() + "/shadow_rendering.vs",
+             res_dir() + "/clustered_forward.fs",
+             ObjectModel::FeatureDefines()),
+      m_lightsDirty(true),
+      m_clusters(CLUSTER_X * CLUSTER_Y * CLUSTER_Z),
+      m_clusterStats() {
+  CreateTextureBuffer(GL_RG32UI, GL_STREAM_DRAW, m_clusterTex, m_clusterTBO);
+  CreateTextureBuffer(GL_R16UI, GL_STREAM_DRAW, m_indexTex, m_indexTBO);
+  CreateTextureBuffer(GL_RGBA32F, GL_STREAM_DRAW, m_lightTex, m_lightTBO);
+  shader.SetDefines({"CLUSTER_X " + std::to_string(CLUSTER_X),
+                     "CLUSTER_Y " + std::to_string(CLUSTER_Y),
+                     "CLUSTER_Z " + std::to_string(CLUSTER_Z)});
+  // the light lists follow the units used by the model's textures
+  shader.SetInitializer([this](Shader& s) {
+    s.setInt("clusters", m_colorTexUnitNum);
+    s.setInt("lightIndices", m_colorTexUnitNum + 1);
+    s.setInt("lights", m_colorTexUnitNum + 2);
+  });
+  m_tileSize = shader.GetUniform<glm::vec2>("tileSize");
+  m_sliceScaleBias = shader.GetUniform<glm::vec2>("sliceScaleBias");
+  m_shaderVariants = {&shader};
+}
+
+ClusteredForwardScheme::ClusteredForwardScheme(const SceneModel* model,
+                                               Navigation* nav)
+    : ClusteredForwardScheme() {
+  SetModel(model);
+  SetNavigation(nav);
+  InitNavigationFromBBox();
+}
+
+ClusteredForwardScheme::~ClusteredForwardScheme() {
+  DeleteTextureBuffer(m_clusterTex, m_clusterTBO);
+  DeleteTextureBuffer(m_indexTex, m_indexTBO);
+  DeleteTextureBuffer(m_lightTex, m_lightTBO);
+  shader.Release();
+  m_litTimer.Release();
+}
+
+void ClusteredForwardScheme::SetLights(const std::vector<Light>& lights) {
+  m_lights.assign(lights.begin(),
+                  lights.begin() + std::min<size_t>(lights.size(), MAX_LIGHTS));
+  m_viewLights.resize(m_lights.size());
+  for (Slice& slice : m_slices) {
+    slice.rects.reserve(m_lights.size());
+    slice.rect_lights.reserve(m_lights.size());
+  }
+  m_lightsDirty = true;
+}
+
+void ClusteredForwardScheme::assignSlice(unsigned int z, float near, float far,
+                                         float proj_x, float proj_y) {
+  Slice& slice = m_slices[z];
+  slice.rects.clear();
+  slice.rect_lights.clear();
+  const float d0 = near * std::pow(far / near, (float)z / CLUSTER_Z);
+  const float d1 = near * std::pow(far / near, (float)(z + 1) / CLUSTER_Z);
+  // NDC to tile index, clamped to the grid
+  auto tile = [](float ndc, unsigned int n) {
+    float t = std::floor((0.5f * ndc + 0.5f) * n);
+    return (unsigned int)std::min(std::max(t, 0.0f), float(n - 1));
+  };
+  unsigned int counts[CLUSTER_X * CLUSTER_Y] = {};
+  for (unsigned int i = 0; i < m_viewLights.size(); ++i) {
+    const glm::vec4& l = m_viewLights[i];
+    // the light's box cut to the slice
+    float lo = std::max(d0, -l.z - l.w), hi = std::min(d1, -l.z + l.w);
+    if (lo > hi) continue;
+    // x / depth is extreme at the near or the far end, by the sign of x
+    auto ndc_min = [lo, hi](float a) { return a >= 0.0f ? a / hi : a / lo; };
+    auto ndc_max = [lo, hi](float a) { return a >= 0.0f ? a / lo : a / hi; };
+    glm::vec2 n0(proj_x * ndc_min(l.x - l.w), proj_y * ndc_min(l.y - l.w));
+    glm::vec2 n1(proj_x * ndc_max(l.x + l.w), proj_y * ndc_max(l.y + l.w));
+    if (n1.x < -1.0f || n0.x > 1.0f || n1.y < -1.0f || n0.y > 1.0f) continue;
+    glm::uvec4 r(tile(n0.x, CLUSTER_X), tile(n1.x, CLUSTER_X),
+                 tile(n0.y, CLUSTER_Y), tile(n1.y, CLUSTER_Y));
+    slice.rects.push_back(r);
+    slice.rect_lights.push_back(i);
+    for (unsigned int y = r.z; y <= r.w; ++y)
+      for (unsigned int x = r.x; x <= r.y; ++x) ++counts[y * CLUSTER_X + x];
+  }
+  // lay out the lists of the slice's clusters, counts become cursors
+  glm::uvec2* clusters = &m_clusters[z * CLUSTER_X * CLUSTER_Y];
+  unsigned int total = 0;
+  for (unsigned int t = 0; t < CLUSTER_X * CLUSTER_Y; ++t) {
+    clusters[t] = glm::uvec2(total, counts[t]);
+    counts[t] = total;
+    total += clusters[t].y;
+  }
+  slice.indices.resize(total);
+  for (size_t j = 0; j < slice.rects.size(); ++j) {
+    const glm::uvec4& r = slice.rects[j];
+    for (unsigned int y = r.z; y <= r.w; ++y)
+      for (unsigned int x = r.x; x <= r.y; ++x)
+        slice.indices[counts[y * CLUSTER_X + x]++] = slice.rect_lights[j];
+  }
+}
+
+void ClusteredForwardScheme::assignLights(const glm::mat4& view, float near,
+                                          float far, float proj_x,
+                                          float proj_y) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < m_lights.size(); ++i)
+    m_viewLights[i] = glm::vec4(
+        glm::vec3(view * glm::vec4(m_lights[i].position, 1.0f)),
+        m_lights[i].radius);
+  auto task = [this, near, far, proj_x, proj_y](unsigned int z) {
+    assignSlice(z, near, far, proj_x, proj_y);
+  };
+  m_threads.ParallelFor(CLUSTER_Z, task);
+  // concatenate the slices
+  m_indices.clear();
+  unsigned int max_lights = 0;
+  for (unsigned int z = 0; z < CLUSTER_Z; ++z) {
+    glm::uvec2* clusters = &m_clusters[z * CLUSTER_X * CLUSTER_Y];
+    for (unsigned int t = 0; t < CLUSTER_X * CLUSTER_Y; ++t) {
+      clusters[t].x += m_indices.size();
+      max_lights = std::max(max_lights, clusters[t].y);
+    }
+    const std::vector<uint16_t>& indices = m_slices[z].indices;
+    m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+  }
+  UploadBuffer(m_clusterTBO, GL_STREAM_DRAW, m_clusters.data(),
+               m_clusters.size() * sizeof(glm::uvec2));
+  UploadBuffer(m_indexTBO, GL_STREAM_DRAW, m_indices.data(),
+               m_indices.size() * sizeof(uint16_t));
+  auto t1 = std::chrono::steady_clock::now();
+  m_clusterStats.assign_ms =
+      std::chrono::duration<double, std::milli>(t1 - t0).count();
+  m_clusterStats.references = m_indices.size();
+  m_clusterStats.max_lights = max_lights;
+}
+
+void ClusteredForwardScheme::Render() {
+  GLState& gl_state = GLState::Instance();
+  const GLint* viewport = gl_state.Viewport();
+  const GLint width = viewport[2], height = viewport[3];
+  Camera& cam = m_navigation->camera();
+  const float near = cam.near_plane, far = cam.far_plane;
+  glm::mat4 projection = glm::perspective(
+      glm::radians(cam.Zoom), (float)width / (float)height, near, far);
+  const glm::mat4 view = cam.GetViewMatrix();
+
+  // 1. assign the lights to the clusters
+  // --------------------------------------------------------------
+  if (m_lightsDirty) {
+    UploadBuffer(m_lightTBO, GL_STREAM_DRAW, m_lights.data(),
+                 m_lights.size() * sizeof(Light));
+    m_lightsDirty = false;
+  }
+  assignLights(view, near, far, projection[0][0], projection[1][1]);
+
+  // 2. shade each fragment with the lights of its cluster
+  // --------------------------------------------------------------
+  m_renderQueue.Clear();
+  SubmitModel(RenderQueue::OPAQUE, shader, view, near, far);
+  m_renderQueue.Sort();
+  FrameUniforms frame;
+  frame.projection = projection;
+  frame.view = view;
+  frame.viewPos = glm::vec4(cam.Position(), 1.0f);
+  m_frameBlock.Bind();
+  m_frameBlock.Update(frame);
+  UpdateObjectBlock();
+  // slice = log(depth) * x + y, inverting the spacing of assignSlice()
+  const float slice_scale = CLUSTER_Z / std::log(far / near);
+  const glm::vec2 slice_scale_bias(slice_scale,
+                                   -slice_scale * std::log(near));
+  const glm::vec2 tile_size((float)width / CLUSTER_X,
+                            (float)height / CLUSTER_Y);
+  shader.set(m_tileSize, tile_size);
+  shader.set(m_sliceScaleBias, slice_scale_bias);
+  gl_state.BindTexture(m_colorTexUnitNum, GL_TEXTURE_BUFFER, m_clusterTex);
+  gl_state.BindTexture(m_colorTexUnitNum + 1, GL_TEXTURE_BUFFER, m_indexTex);
+  gl_state.BindTexture(m_colorTexUnitNum + 2, GL_TEXTURE_BUFFER, m_lightTex);
+  glEnable(GL_DEPTH_TEST);
+  glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  m_litTimer.Begin();
+  m_renderQueue.Draw(RenderQueue::OPAQUE, &m_objectBlock);
+  m_litTimer.End();
+}
@@ -0,0 +1,81 @@
+#ifndef _3D_VIEWER_CLUSTERED_SCHEME_H
+#define _3D_VIEWER_CLUSTERED_SCHEME_H
+
+#include <cstdint>
+#include <vector>
+
+#include "light.h"
+#include "rendering_scheme.h"
+#include "thread_pool.h"
+
+/** Forward shading for many point and spot lights. The view frustum is cut
+ * into CLUSTER_X x CLUSTER_Y screen tiles times CLUSTER_Z slices spaced
+ * exponentially in depth. Each frame the lights are assigned to the clusters
+ * they overlap on the CPU, one depth slice per task, and each fragment is
+ * shaded with the lights of its cluster only. Unlike deferred shading this
+ * keeps MSAA and blending available.
+ *
+ * The lists reach the shader as texture buffers: (first, count) per cluster
+ * (RG32UI), the concatenated light indices (R16UI) and the lights (RGBA32F,
+ * three texels per Light).
+ */
+class ClusteredForwardScheme : public RenderingScheme {
+ public:
+  static const unsigned int CLUSTER_X = 16, CLUSTER_Y = 9, CLUSTER_Z = 24;
+  static const unsigned int MAX_LIGHTS = 0xFFFF;  // 16-bit indices
+
+  ClusteredForwardScheme();
+  ClusteredForwardScheme(const SceneModel*, Navigation*);
+  ~ClusteredForwardScheme();
+  // lights beyond MAX_LIGHTS are dropped
+  void SetLights(const std::vector<Light>& lights);
+  const std::vector<Light>& GetLights() const { return m_lights; }
+  virtual void Render() override;
+  virtual TimerList Timers() override { return {{"lit pass", &m_litTimer}}; }
+
+  /** light assignment of the last frame
+   */
+  struct ClusterStats {
+    double assign_ms;          // CPU time, including the upload
+    unsigned int references;   // light indices over all clusters
+    unsigned int max_lights;   // most lights in one cluster
+  };
+  const ClusterStats& GetClusterStats() const { return m_clusterStats; }
+
+ private:
+  ShaderVariants shader;
+  VariantUniform<glm::vec2> m_tileSize, m_sliceScaleBias;
+  // texture buffers and their buffer objects
+  unsigned int m_clusterTex, m_clusterTBO;
+  unsigned int m_indexTex, m_indexTBO;
+  unsigned int m_lightTex, m_lightTBO;
+  std::vector<Light> m_lights;
+  bool m_lightsDirty;  // m_lightTBO is behind m_lights
+  // per frame: view-space center and radius of each light
+  std::vector<glm::vec4> m_viewLights;
+  // (first, count) per cluster, first relative to the slice until merged
+  std::vector<glm::uvec2> m_clusters;
+  /** lights of one depth slice, filled by its task
+   */
+  struct Slice {
+    // tile rectangle (x0, x1, y0, y1) of each light touching the slice
+    std::vector<glm::uvec4> rects;
+    std::vector<uint16_t> rect_lights;
+    std::vector<uint16_t> indices;  // light lists of the slice's clusters
+  };
+  Slice m_slices[CLUSTER_Z];
+  std::vector<uint16_t> m_indices;  // all slices, as uploaded
+  ThreadPool m_threads;
+  ClusterStats m_clusterStats;
+  GpuTimer m_litTimer;
+
+  /** assign the lights to the clusters of slice z; proj_x and proj_y scale
+   * view-space x / depth to NDC
+   */
+  void assignSlice(unsigned int z, float near, float far, float proj_x,
+                   float proj_y);
+  void assignLights(const glm::mat4& view, float near, float far,
+                    float proj_x, float proj_y);
+};
+
+#endif  // _3D_VIEWER_CLUSTERED_SCHEME_H
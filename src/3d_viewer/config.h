@@ -8,6 +8,7 @@ class Config final {
   std::string exe_dir;
   std::string resource_dir;
   std::string shader_dir;
+  std::string shader_cache_dir;  // linked program binaries, "" to disable
 
   static Config& Instance() {
     static Config config;
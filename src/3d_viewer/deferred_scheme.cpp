@@ -0,0 +1,258 @@
+#include <glad/glad.h>
+
+#include "deferred_scheme.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <utility>
+
+#include "config.h"
+#include "gl_state.h"
+#include "gl_util.h"
+
+static const std::string& res_dir() { return Config::Instance().shader_dir; }
+
+/** triangles of an icosahedron subdivided once, scaled so that its faces
+ * enclose the unit sphere, wound counter-clockwise seen from outside
+ */
+static std::vector<glm::vec3> LightVolumeTriangles() {
+  const float t = 0.5f * (1.0f + std::sqrt(5.0f));
+  const glm::vec3 v[12] = {{-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+                           {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+                           {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+  const int faces[20][3] = {{0, 11, 5}, {0, 5, 1},  {0, 1, 7},   {0, 7, 10},
+                            {0, 10, 11}, {1, 5, 9}, {5, 11, 4},  {11, 10, 2},
+                            {10, 7, 6}, {7, 1, 8},  {3, 9, 4},   {3, 4, 2},
+                            {3, 2, 6},  {3, 6, 8},  {3, 8, 9},   {4, 9, 5},
+                            {2, 4, 11}, {6, 2, 10}, {8, 6, 7},   {9, 8, 1}};
+  std::vector<glm::vec3> triangles;
+  triangles.reserve(20 * 4 * 3);
+  auto add = [&triangles](glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    if (glm::dot(glm::cross(b - a, c - a), a + b + c) < 0.0f) std::swap(b, c);
+    triangles.insert(triangles.end(), {a, b, c});
+  };
+  for (const int* f : faces) {
+    glm::vec3 a = glm::normalize(v[f[0]]), b = glm::normalize(v[f[1]]),
+              c = glm::normalize(v[f[2]]);
+    glm::vec3 ab = glm::normalize(a + b), bc = glm::normalize(b + c),
+              ca = glm::normalize(c + a);
+    add(a, ab, ca);
+    add(b, bc, ab);
+    add(c, ca, bc);
+    add(ab, bc, ca);
+  }
+  // the vertices lie on the sphere; push the faces out to touch it
+  float inradius = 1.0f;
+  for (size_t i = 0; i < triangles.size(); i += 3) {
+    const glm::vec3 &a = triangles[i], &b = triangles[i + 1],
+                    &c = triangles[i + 2];
+    glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
+    inradius = std::min(inradius, glm::dot(n, a));
+  }
+  for (glm::vec3& p : triangles) p /= inradius;
+  return triangles;
+}
+
+DeferredRenderingScheme::DeferredRenderingScheme()
+    : gbufferShader(res_dir() + "/shadow_rendering.vs",
+                    res_dir() + "/gbuffer.fs", ObjectModel::FeatureDefines()),
+      ambientShader((res_dir() + "/fullscreen.vs").c_str(),
+                    (res_dir() + "/deferred_ambient.fs").c_str()),
+      lightShader((res_dir() + "/light_volume.vs").c_str(),
+                  (res_dir() + "/deferred_light.fs").c_str()),
+      gAlbedoSpec(0),
+      gNormalShininess(0),
+      gDepth(0),
+      m_gbufferWidth(0),
+      m_gbufferHeight(0),
+      m_lightsDirty(true) {
+  glGenFramebuffers(1, &gbufferFBO);
+  glGenVertexArrays(1, &m_emptyVAO);
+  createLightVolume();
+  m_ambientAlbedo = ambientShader.GetUniform<int>("gAlbedoSpec");
+  m_ambientDepth = ambientShader.GetUniform<int>("gDepth");
+  m_lightAlbedo = lightShader.GetUniform<int>("gAlbedoSpec");
+  m_lightNormal = lightShader.GetUniform<int>("gNormalShininess");
+  m_lightDepth = lightShader.GetUniform<int>("gDepth");
+  m_invViewProjection = lightShader.GetUniform<glm::mat4>("invViewProjection");
+  m_shaders = {&ambientShader, &lightShader};
+  m_shaderVariants = {&gbufferShader};
+}
+
+DeferredRenderingScheme::DeferredRenderingScheme(const SceneModel* model,
+                                                 Navigation* nav)
+    : DeferredRenderingScheme() {
+  SetModel(model);
+  SetNavigation(nav);
+  InitNavigationFromBBox();
+}
+
+DeferredRenderingScheme::~DeferredRenderingScheme() {
+  GLState& gl_state = GLState::Instance();
+  releaseGBuffer();
+  gl_state.ForgetFramebuffer(gbufferFBO);
+  gl_state.ForgetVertexArray(m_volumeVAO);
+  gl_state.ForgetVertexArray(m_emptyVAO);
+  glDeleteFramebuffers(1, &gbufferFBO);
+  glDeleteVertexArrays(1, &m_volumeVAO);
+  glDeleteVertexArrays(1, &m_emptyVAO);
+  glDeleteBuffers(1, &m_volumeVBO);
+  glDeleteBuffers(1, &m_lightVBO);
+  gbufferShader.Release();
+  ambientShader.Release();
+  lightShader.Release();
+  m_geometryTimer.Release();
+  m_lightingTimer.Release();
+}
+
+void DeferredRenderingScheme::createLightVolume() {
+  std::vector<glm::vec3> triangles = LightVolumeTriangles();
+  m_volumeVertexCount = triangles.size();
+  glGenVertexArrays(1, &m_volumeVAO);
+  glGenBuffers(1, &m_volumeVBO);
+  glGenBuffers(1, &m_lightVBO);
+  GLState::Instance().BindVertexArray(m_volumeVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, m_volumeVBO);
+  glBufferData(GL_ARRAY_BUFFER, triangles.size() * sizeof(glm::vec3),
+               triangles.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3),
+                        (void*)0);
+  // one Light per instance, as three vec4
+  glBindBuffer(GL_ARRAY_BUFFER, m_lightVBO);
+  for (int i = 0; i < 3; ++i) {
+    glEnableVertexAttribArray(1 + i);
+    glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Light),
+                          (void*)(i * sizeof(glm::vec4)));
+    glVertexAttribDivisor(1 + i, 1);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DeferredRenderingScheme::resizeGBuffer(int width, int height) {
+  releaseGBuffer();
+  m_gbufferWidth = width;
+  m_gbufferHeight = height;
+  gAlbedoSpec = CreateTarget(width, height, GL_RGBA8, GL_RGBA,
+                             GL_UNSIGNED_BYTE);
+  gNormalShininess = CreateTarget(width, height, GL_RGBA16, GL_RGBA,
+                                  GL_UNSIGNED_SHORT);
+  // same format as the default framebuffer's depth, for the blit
+  gDepth = CreateTarget(width, height, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+                        GL_UNSIGNED_INT_24_8);
+  GLState::Instance().BindFramebuffer(gbufferFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         gAlbedoSpec, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         gNormalShininess, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                         GL_TEXTURE_2D, gDepth, 0);
+  const GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, buffers);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "G-buffer framebuffer is not complete" << std::endl;
+}
+
+void DeferredRenderingScheme::releaseGBuffer() {
+  for (unsigned int* texture : {&gAlbedoSpec, &gNormalShininess, &gDepth}) {
+    if (*texture == 0) continue;
+    GLState::Instance().ForgetTexture(*texture);
+    glDeleteTextures(1, texture);
+    *texture = 0;
+  }
+}
+
+void DeferredRenderingScheme::Render() {
+  GLState& gl_state = GLState::Instance();
+  const GLint* viewport = gl_state.Viewport();
+  const GLint width = viewport[2], height = viewport[3];
+  if (width != m_gbufferWidth || height != m_gbufferHeight)
+    resizeGBuffer(width, height);
+
+  Camera& cam = m_navigation->camera();
+  glm::mat4 projection =
+      glm::perspective(glm::radians(cam.Zoom), (float)width / (float)height,
+                       cam.near_plane, cam.far_plane);
+  const glm::mat4 view = cam.GetViewMatrix();
+  m_renderQueue.Clear();
+  SubmitModel(RenderQueue::OPAQUE, gbufferShader, view, cam.near_plane,
+              cam.far_plane);
+  m_renderQueue.Sort();
+  FrameUniforms frame;
+  frame.projection = projection;
+  frame.view = view;
+  frame.viewPos = glm::vec4(cam.Position(), 1.0f);
+  m_frameBlock.Bind();
+  m_frameBlock.Update(frame);
+  UpdateObjectBlock();
+  if (m_lightsDirty) {
+    glBindBuffer(GL_ARRAY_BUFFER, m_lightVBO);
+    glBufferData(GL_ARRAY_BUFFER, m_lights.size() * sizeof(Light),
+                 m_lights.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_lightsDirty = false;
+  }
+
+  // 1. geometry pass: surfaces into the G-buffer
+  // --------------------------------------------------------------
+  m_geometryTimer.Begin();
+  gl_state.BindFramebuffer(gbufferFBO);
+  glEnable(GL_DEPTH_TEST);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  m_renderQueue.Draw(RenderQueue::OPAQUE, &m_objectBlock);
+  m_geometryTimer.End();
+
+  // 2. lighting pass: ambient everywhere, then each light over its volume
+  // --------------------------------------------------------------
+  m_lightingTimer.Begin();
+  // the scene depth limits the light volumes, and later passes can draw
+  // over the result
+  gl_state.BindFramebuffer(0);
+  gl_state.BindReadFramebuffer(gbufferFBO);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  gl_state.BindReadFramebuffer(0);
+  glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  gl_state.BindTexture(0, GL_TEXTURE_2D, gAlbedoSpec);
+  gl_state.BindTexture(1, GL_TEXTURE_2D, gNormalShininess);
+  gl_state.BindTexture(2, GL_TEXTURE_2D, gDepth);
+  glDisable(GL_DEPTH_TEST);
+  ambientShader.use();
+  ambientShader.set(m_ambientAlbedo, 0);
+  ambientShader.set(m_ambientDepth, 2);
+  gl_state.BindVertexArray(m_emptyVAO);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  if (!m_lights.empty()) {
+    // Back faces behind the scene depth cover the pixels the light may
+    // reach, also with the camera inside the volume. Depth clamping keeps
+    // the back faces beyond the far plane.
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_GEQUAL);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    lightShader.use();
+    lightShader.set(m_lightAlbedo, 0);
+    lightShader.set(m_lightNormal, 1);
+    lightShader.set(m_lightDepth, 2);
+    lightShader.set(m_invViewProjection, glm::inverse(projection * view));
+    gl_state.BindVertexArray(m_volumeVAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, m_volumeVertexCount,
+                          m_lights.size());
+    glDisable(GL_BLEND);
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_CLAMP);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+  }
+  glEnable(GL_DEPTH_TEST);
+  m_lightingTimer.End();
+}
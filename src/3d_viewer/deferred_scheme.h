@@ -0,0 +1,59 @@
+#ifndef _3D_VIEWER_DEFERRED_SCHEME_H
+#define _3D_VIEWER_DEFERRED_SCHEME_H
+
+#include <vector>
+
+#include "light.h"
+#include "rendering_scheme.h"
+
+/** Deferred shading for many point and spot lights. The geometry pass writes
+ * the surface of each pixel to a G-buffer; each light then draws its bounding
+ * volume and shades only the pixels inside it, so the cost of a light
+ * follows the area it covers on screen, not the geometry.
+ *
+ * G-buffer, 16 bytes per pixel:
+ *   RGBA8             albedo, specular strength
+ *   RGBA16            octahedral normal (xy), log2 of the shininess (z)
+ *   DEPTH24_STENCIL8  depth, positions are reconstructed from it
+ */
+class DeferredRenderingScheme : public RenderingScheme {
+ public:
+  DeferredRenderingScheme();
+  DeferredRenderingScheme(const SceneModel*, Navigation*);
+  ~DeferredRenderingScheme();
+  void SetLights(const std::vector<Light>& lights) {
+    m_lights = lights;
+    m_lightsDirty = true;
+  }
+  const std::vector<Light>& GetLights() const { return m_lights; }
+  virtual void Render() override;
+  virtual TimerList Timers() override {
+    return {{"geometry pass", &m_geometryTimer},
+            {"lighting", &m_lightingTimer}};
+  }
+
+ private:
+  ShaderVariants gbufferShader;
+  Shader ambientShader, lightShader;
+  unsigned int gbufferFBO;
+  unsigned int gAlbedoSpec, gNormalShininess, gDepth;
+  int m_gbufferWidth, m_gbufferHeight;
+  // polyhedron enclosing the unit sphere, drawn once per light with the
+  // lights as instance attributes
+  unsigned int m_volumeVAO, m_volumeVBO, m_lightVBO;
+  unsigned int m_volumeVertexCount;
+  unsigned int m_emptyVAO;  // for full-screen triangles
+  std::vector<Light> m_lights;
+  bool m_lightsDirty;  // m_lightVBO is behind m_lights
+  UniformHandle<int> m_ambientAlbedo, m_ambientDepth;
+  UniformHandle<int> m_lightAlbedo, m_lightNormal, m_lightDepth;
+  UniformHandle<glm::mat4> m_invViewProjection;
+  GpuTimer m_geometryTimer, m_lightingTimer;
+
+  // (re)create the G-buffer textures at the viewport size
+  void resizeGBuffer(int width, int height);
+  void releaseGBuffer();
+  void createLightVolume();
+};
+
+#endif  // _3D_VIEWER_DEFERRED_SCHEME_H
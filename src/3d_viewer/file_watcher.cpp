@@ -0,0 +1,62 @@
+#include "file_watcher.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::FileWatcher(const std::string &dir) : m_fd(-1), m_stop(false) {
+#ifdef __linux__
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0) return;
+  // editors either rewrite a file in place or move a new one over it
+  if (inotify_add_watch(m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    std::cerr << "cannot watch directory: " << dir << std::endl;
+    close(m_fd);
+    m_fd = -1;
+    return;
+  }
+  m_thread = std::thread(&FileWatcher::run, this);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+  m_stop = true;
+  if (m_thread.joinable()) m_thread.join();
+#ifdef __linux__
+  if (m_fd >= 0) close(m_fd);
+#endif
+}
+
+std::vector<std::string> FileWatcher::TakeChanged() {
+  std::vector<std::string> changed;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  changed.swap(m_changed);
+  return changed;
+}
+
+void FileWatcher::run() {
+#ifdef __linux__
+  alignas(inotify_event) char buf[4096];
+  pollfd pfd = {m_fd, POLLIN, 0};
+  while (!m_stop) {
+    // wake up regularly to check m_stop
+    if (poll(&pfd, 1, 100) <= 0) continue;
+    ssize_t len = read(m_fd, buf, sizeof(buf));
+    for (char *p = buf; len > 0 && p < buf + len;) {
+      const inotify_event *event = (const inotify_event *)p;
+      p += sizeof(inotify_event) + event->len;
+      if (event->len == 0) continue;
+      std::string name(event->name);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (std::find(m_changed.begin(), m_changed.end(), name) ==
+          m_changed.end())
+        m_changed.push_back(name);
+    }
+  }
+#endif
+}
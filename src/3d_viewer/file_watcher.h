@@ -0,0 +1,36 @@
+#ifndef _3D_VIEWER_FILE_WATCHER_H
+#define _3D_VIEWER_FILE_WATCHER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Watches a directory for files written or moved into it, on a background
+ * thread (inotify, Linux only; inactive elsewhere). The render loop collects
+ * the changes with TakeChanged().
+ */
+class FileWatcher {
+ public:
+  explicit FileWatcher(const std::string &dir);
+  ~FileWatcher();
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+  bool Active() const { return m_fd >= 0; }
+  /** names (without directory) of the files changed since the last call
+   */
+  std::vector<std::string> TakeChanged();
+
+ private:
+  int m_fd;
+  std::atomic<bool> m_stop;
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::vector<std::string> m_changed;
+
+  void run();
+};
+
+#endif  // _3D_VIEWER_FILE_WATCHER_H
@@ -0,0 +1,64 @@
+#include "gl_ext.h"
+
+#include <cstring>
+
+PFNGLGETPROGRAMBINARYPROC glext_glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC glext_glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC glext_glProgramParameteri = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glext_glMaxShaderCompilerThreadsKHR =
+    nullptr;
+
+namespace {
+GLExtensions extensions;
+
+bool HasExtension(const char *name) {
+  GLint n = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+  for (GLint i = 0; i < n; ++i) {
+    const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (ext && std::strcmp(ext, name) == 0) return true;
+  }
+  return false;
+}
+
+bool HasVersion(int major, int minor) {
+  GLint v_major = 0, v_minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &v_major);
+  glGetIntegerv(GL_MINOR_VERSION, &v_minor);
+  return v_major > major || (v_major == major && v_minor >= minor);
+}
+}  // namespace
+
+void LoadGLExtensions(GLADloadproc load) {
+  extensions = GLExtensions();
+
+  if (HasVersion(4, 1) || HasExtension("GL_ARB_get_program_binary")) {
+    glext_glGetProgramBinary =
+        (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+    glext_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+    glext_glProgramParameteri =
+        (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+    GLint formats = 0;
+    if (glext_glGetProgramBinary && glext_glProgramBinary &&
+        glext_glProgramParameteri)
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    // some drivers expose the entry points but no binary format
+    extensions.program_binary = formats > 0;
+  }
+
+  if (HasExtension("GL_KHR_parallel_shader_compile"))
+    glext_glMaxShaderCompilerThreadsKHR =
+        (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+            "glMaxShaderCompilerThreadsKHR");
+  else if (HasExtension("GL_ARB_parallel_shader_compile"))
+    glext_glMaxShaderCompilerThreadsKHR =
+        (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+            "glMaxShaderCompilerThreadsARB");
+  if (glext_glMaxShaderCompilerThreadsKHR) {
+    // let the driver pick the number of compiler threads
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    extensions.parallel_shader_compile = true;
+  }
+}
+
+const GLExtensions &GLExt() { return extensions; }
@@ -0,0 +1,50 @@
+#ifndef _3D_VIEWER_GL_EXT_H
+#define _3D_VIEWER_GL_EXT_H
+
+#include <glad/glad.h>
+
+/* OpenGL beyond the 3.3 core profile loaded by glad. Entry points are null
+ * unless the matching flag of GLExt() is set after LoadGLExtensions().
+ */
+
+// GL 4.1 / ARB_get_program_binary
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void(APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program,
+                                                  GLsizei bufSize,
+                                                  GLsizei *length,
+                                                  GLenum *binaryFormat,
+                                                  void *binary);
+typedef void(APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program,
+                                               GLenum binaryFormat,
+                                               const void *binary,
+                                               GLsizei length);
+typedef void(APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program,
+                                                   GLenum pname, GLint value);
+extern PFNGLGETPROGRAMBINARYPROC glext_glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glext_glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC glext_glProgramParameteri;
+#define glGetProgramBinary glext_glGetProgramBinary
+#define glProgramBinary glext_glProgramBinary
+#define glProgramParameteri glext_glProgramParameteri
+
+// KHR_parallel_shader_compile / ARB_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glext_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR glext_glMaxShaderCompilerThreadsKHR
+
+struct GLExtensions {
+  bool program_binary = false;
+  // compile and link return at once, poll GL_COMPLETION_STATUS_KHR
+  bool parallel_shader_compile = false;
+};
+
+/** load the optional entry points, needs a current context
+ */
+void LoadGLExtensions(GLADloadproc load);
+const GLExtensions &GLExt();
+
+#endif  // _3D_VIEWER_GL_EXT_H
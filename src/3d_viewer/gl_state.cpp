@@ -0,0 +1,145 @@
+#include "gl_state.h"
+
+int GLState::TargetIndex(GLenum target) {
+  switch (target) {
+    case GL_TEXTURE_2D:
+      return 0;
+    case GL_TEXTURE_2D_ARRAY:
+      return 1;
+    case GL_TEXTURE_CUBE_MAP:
+      return 2;
+    case GL_TEXTURE_BUFFER:
+      return 3;
+    default:
+      return -1;
+  }
+}
+
+void GLState::UseProgram(GLuint program) {
+  if (Update(m_program, program)) glUseProgram(program);
+}
+
+void GLState::BindVertexArray(GLuint vao) {
+  if (Update(m_vao, vao)) glBindVertexArray(vao);
+}
+
+void GLState::ActiveTexture(GLuint unit) {
+  if (Update(m_activeUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::BindTexture(GLuint unit, GLenum target, GLuint texture) {
+  int t = TargetIndex(target);
+  if (t < 0 || unit >= MAX_TEXTURE_UNITS) {
+    // untracked binding point, always forward
+    ActiveTexture(unit);
+    ++m_counters.issued;
+    glBindTexture(target, texture);
+    return;
+  }
+  if (m_textures[unit][t] == texture) {
+    ++m_counters.elided;
+    return;
+  }
+  ActiveTexture(unit);
+  Update(m_textures[unit][t], texture);
+  glBindTexture(target, texture);
+}
+
+void GLState::BindFramebuffer(GLuint fbo) {
+  if (m_fbo == fbo && m_readFbo == fbo) {
+    ++m_counters.elided;
+    return;
+  }
+  m_fbo = m_readFbo = fbo;
+  ++m_counters.issued;
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void GLState::BindReadFramebuffer(GLuint fbo) {
+  if (Update(m_readFbo, fbo)) glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+}
+
+void GLState::BindUniformBuffer(GLuint binding, GLuint ubo) {
+  if (binding >= MAX_UNIFORM_BINDINGS) {
+    ++m_counters.issued;
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+    return;
+  }
+  if (m_uniformBuffers[binding] == ubo && m_uniformOffsets[binding] == -1) {
+    ++m_counters.elided;
+    return;
+  }
+  m_uniformBuffers[binding] = ubo;
+  m_uniformOffsets[binding] = -1;
+  ++m_counters.issued;
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+}
+
+void GLState::BindUniformBufferRange(GLuint binding, GLuint ubo,
+                                     GLintptr offset, GLsizeiptr size) {
+  if (binding < MAX_UNIFORM_BINDINGS) {
+    if (m_uniformBuffers[binding] == ubo &&
+        m_uniformOffsets[binding] == offset) {
+      ++m_counters.elided;
+      return;
+    }
+    m_uniformBuffers[binding] = ubo;
+    m_uniformOffsets[binding] = offset;
+  }
+  ++m_counters.issued;
+  glBindBufferRange(GL_UNIFORM_BUFFER, binding, ubo, offset, size);
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  if (m_viewportKnown && m_viewport[0] == x && m_viewport[1] == y &&
+      m_viewport[2] == width && m_viewport[3] == height) {
+    ++m_counters.elided;
+    return;
+  }
+  m_viewport[0] = x;
+  m_viewport[1] = y;
+  m_viewport[2] = width;
+  m_viewport[3] = height;
+  m_viewportKnown = true;
+  ++m_counters.issued;
+  glViewport(x, y, width, height);
+}
+
+void GLState::ForgetProgram(GLuint program) {
+  if (m_program == program) m_program = 0;
+}
+
+void GLState::ForgetVertexArray(GLuint vao) {
+  if (m_vao == vao) m_vao = 0;
+}
+
+void GLState::ForgetTexture(GLuint texture) {
+  // deleting a bound texture reverts the binding to 0
+  for (GLuint u = 0; u < MAX_TEXTURE_UNITS; ++u)
+    for (int t = 0; t < TARGET_NUM; ++t)
+      if (m_textures[u][t] == texture) m_textures[u][t] = 0;
+}
+
+void GLState::ForgetFramebuffer(GLuint fbo) {
+  if (m_fbo == fbo) m_fbo = 0;
+  if (m_readFbo == fbo) m_readFbo = 0;
+}
+
+void GLState::ForgetUniformBuffer(GLuint ubo) {
+  for (GLuint b = 0; b < MAX_UNIFORM_BINDINGS; ++b)
+    if (m_uniformBuffers[b] == ubo) m_uniformBuffers[b] = 0;
+}
+
+void GLState::Invalidate() {
+  m_program = UNKNOWN;
+  m_vao = UNKNOWN;
+  m_activeUnit = UNKNOWN;
+  for (GLuint u = 0; u < MAX_TEXTURE_UNITS; ++u)
+    for (int t = 0; t < TARGET_NUM; ++t) m_textures[u][t] = UNKNOWN;
+  m_fbo = UNKNOWN;
+  m_readFbo = UNKNOWN;
+  for (GLuint b = 0; b < MAX_UNIFORM_BINDINGS; ++b)
+    m_uniformBuffers[b] = UNKNOWN;
+  // keep the last viewport readable, but issue the next one
+  m_viewportKnown = false;
+}
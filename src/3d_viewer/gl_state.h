@@ -0,0 +1,94 @@
+#ifndef _3D_VIEWER_GL_STATE_H
+#define _3D_VIEWER_GL_STATE_H
+
+#include <glad/glad.h>
+
+/** Shadow copy of the GL bindings we change per draw. Bind calls that would
+ * not change the current state are skipped, and the state is never read back
+ * from the driver. All binds of program, VAO, texture, FBO, uniform buffer
+ * and viewport must go through this class, and deleted objects must be
+ * forgotten, or the shadow state goes stale.
+ */
+class GLState final {
+ public:
+  struct Counters {
+    unsigned long issued = 0;  // calls forwarded to GL
+    unsigned long elided = 0;  // redundant calls skipped
+  };
+
+  static GLState& Instance() {
+    static GLState state;
+    return state;
+  }
+
+  void UseProgram(GLuint program);
+  // program in use, ~0u if unknown
+  GLuint Program() const { return m_program; }
+  void BindVertexArray(GLuint vao);
+  void ActiveTexture(GLuint unit);  // unit index, not GL_TEXTUREi
+  void BindTexture(GLuint unit, GLenum target, GLuint texture);
+  // bind to the currently active unit
+  void BindTexture(GLenum target, GLuint texture) {
+    BindTexture(m_activeUnit, target, texture);
+  }
+  // GL_FRAMEBUFFER: the draw and the read framebuffer
+  void BindFramebuffer(GLuint fbo);
+  // only the read framebuffer, e.g. the source of a blit
+  void BindReadFramebuffer(GLuint fbo);
+  void BindUniformBuffer(GLuint binding, GLuint ubo);
+  void BindUniformBufferRange(GLuint binding, GLuint ubo, GLintptr offset,
+                              GLsizeiptr size);
+  void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+  const GLint* Viewport() const { return m_viewport; }
+
+  // reset bindings to deleted objects
+  void ForgetProgram(GLuint program);
+  void ForgetVertexArray(GLuint vao);
+  void ForgetTexture(GLuint texture);
+  void ForgetFramebuffer(GLuint fbo);
+  void ForgetUniformBuffer(GLuint ubo);
+  // mark all state unknown, e.g. after code that binds GL state directly
+  void Invalidate();
+
+  const Counters& GetCounters() const { return m_counters; }
+  void ResetCounters() { m_counters = Counters(); }
+
+ private:
+  static const GLuint MAX_TEXTURE_UNITS = 32;
+  static const int TARGET_NUM = 4;  // 2D, 2D array, cube map, buffer
+  static const GLuint MAX_UNIFORM_BINDINGS = 16;
+  static const GLuint UNKNOWN = ~0u;
+
+  GLuint m_program;
+  GLuint m_vao;
+  GLuint m_activeUnit;
+  GLuint m_textures[MAX_TEXTURE_UNITS][TARGET_NUM];
+  GLuint m_fbo;  // draw framebuffer
+  GLuint m_readFbo;
+  GLuint m_uniformBuffers[MAX_UNIFORM_BINDINGS];
+  GLintptr m_uniformOffsets[MAX_UNIFORM_BINDINGS];  // -1: whole buffer
+  GLint m_viewport[4] = {0, 0, 0, 0};
+  bool m_viewportKnown;
+  Counters m_counters;
+
+  static int TargetIndex(GLenum target);
+  // count a call, return true if it has to be issued
+  bool Update(GLuint& current, GLuint value) {
+    if (current == value) {
+      ++m_counters.elided;
+      return false;
+    }
+    current = value;
+    ++m_counters.issued;
+    return true;
+  }
+
+  GLState() { Invalidate(); }
+  ~GLState() = default;
+  GLState(const GLState&) = delete;
+  GLState(GLState&&) = delete;
+  GLState& operator=(const GLState&) = delete;
+  GLState& operator=(GLState&&) = delete;
+};
+
+#endif  // _3D_VIEWER_GL_STATE_H
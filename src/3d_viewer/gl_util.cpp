@@ -0,0 +1,45 @@
+#include "gl_util.h"
+
+#include <algorithm>
+
+#include "gl_state.h"
+
+unsigned int CreateTarget(int width, int height, GLenum internal_format,
+                          GLenum format, GLenum type) {
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  GLState::Instance().BindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format,
+               type, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
+
+void CreateTextureBuffer(GLenum format, GLenum usage, unsigned int& texture,
+                         unsigned int& buffer) {
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  glBufferData(GL_TEXTURE_BUFFER, 16, NULL, usage);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glGenTextures(1, &texture);
+  GLState::Instance().BindTexture(GL_TEXTURE_BUFFER, texture);
+  glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+}
+
+void UploadBuffer(unsigned int buffer, GLenum usage, const void* data,
+                  size_t size) {
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(size, 16), NULL, usage);
+  if (size > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void DeleteTextureBuffer(unsigned int& texture, unsigned int& buffer) {
+  GLState::Instance().ForgetTexture(texture);
+  glDeleteTextures(1, &texture);
+  glDeleteBuffers(1, &buffer);
+  texture = buffer = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef _3D_VIEWER_GL_UTIL_H
+#define _3D_VIEWER_GL_UTIL_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+/* Textures and buffers shared by the rendering schemes. Textures are bound
+ * through GLState, buffers are left unbound.
+ */
+
+// nearest-filtered render target, clamped to the edge
+unsigned int CreateTarget(int width, int height, GLenum internal_format,
+                          GLenum format, GLenum type);
+
+/** buffer texture reading buffer as format. usage is the hint of the
+ * buffer's storage, e.g. GL_STATIC_DRAW for data uploaded once and
+ * GL_STREAM_DRAW for data replaced every frame.
+ */
+void CreateTextureBuffer(GLenum format, GLenum usage, unsigned int& texture,
+                         unsigned int& buffer);
+/** replace the contents of buffer, never leaving it empty. The storage is
+ * orphaned, so the GPU may still read the old contents.
+ */
+void UploadBuffer(unsigned int buffer, GLenum usage, const void* data,
+                  size_t size);
+void DeleteTextureBuffer(unsigned int& texture, unsigned int& buffer);
+
+#endif  // _3D_VIEWER_GL_UTIL_H
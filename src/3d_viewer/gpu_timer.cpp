@@ -0,0 +1,58 @@
+#include <glad/glad.h>
+
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer()
+    : m_queries(), m_pending(), m_next(0), m_running(false), m_totalMs(0.0),
+      m_samples(0) {}
+
+void GpuTimer::Release() {
+  // the queries are created by the first Begin()
+  if (m_queries[0] != 0) glDeleteQueries(QUERY_NUM, m_queries);
+  for (int i = 0; i < QUERY_NUM; ++i) {
+    m_queries[i] = 0;
+    m_pending[i] = false;
+  }
+}
+
+void GpuTimer::Begin() {
+  if (m_queries[0] == 0) glGenQueries(QUERY_NUM, m_queries);
+  collect();
+  // if the GPU is more than QUERY_NUM frames behind, skip this measurement
+  m_running = !m_pending[m_next];
+  if (m_running) glBeginQuery(GL_TIME_ELAPSED, m_queries[m_next]);
+}
+
+void GpuTimer::End() {
+  if (!m_running) return;
+  glEndQuery(GL_TIME_ELAPSED);
+  m_pending[m_next] = true;
+  m_next = (m_next + 1) % QUERY_NUM;
+  m_running = false;
+}
+
+void GpuTimer::Reset() {
+  // results of queries issued before the reset are ignored
+  for (int i = 0; i < QUERY_NUM; ++i) {
+    if (!m_pending[i]) continue;
+    GLuint64 ns;
+    glGetQueryObjectui64v(m_queries[i], GL_QUERY_RESULT, &ns);
+    m_pending[i] = false;
+  }
+  m_totalMs = 0.0;
+  m_samples = 0;
+}
+
+void GpuTimer::collect() {
+  for (int i = 0; i < QUERY_NUM; ++i) {
+    if (!m_pending[i]) continue;
+    GLint available = 0;
+    glGetQueryObjectiv(m_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) continue;
+    GLuint64 ns;
+    glGetQueryObjectui64v(m_queries[i], GL_QUERY_RESULT, &ns);
+    m_pending[i] = false;
+    m_totalMs += ns * 1e-6;
+    ++m_samples;
+  }
+}
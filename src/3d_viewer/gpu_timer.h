@@ -0,0 +1,38 @@
+#ifndef _3D_VIEWER_GPU_TIMER_H
+#define _3D_VIEWER_GPU_TIMER_H
+
+/** GPU time of the commands between Begin() and End(), measured with
+ * GL_TIME_ELAPSED queries. Results are collected a few frames late, so the
+ * CPU never waits for the GPU. Only one timer can run at a time.
+ */
+class GpuTimer {
+ public:
+  GpuTimer();
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+  void Release();
+
+  void Begin();
+  void End();
+  /** mean of the results collected since Reset(), in milliseconds
+   */
+  double AverageMs() const {
+    return m_samples > 0 ? m_totalMs / m_samples : 0.0;
+  }
+  unsigned long Samples() const { return m_samples; }
+  // drop the results so far, queries in flight are discarded too
+  void Reset();
+
+ private:
+  static const int QUERY_NUM = 4;  // frames a result may lag behind
+  unsigned int m_queries[QUERY_NUM];
+  bool m_pending[QUERY_NUM];
+  int m_next;
+  bool m_running;
+  double m_totalMs;
+  unsigned long m_samples;
+
+  void collect();
+};
+
+#endif  // _3D_VIEWER_GPU_TIMER_H
@@ -0,0 +1,46 @@
+#include "light.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+Light Light::Point(const glm::vec3& p, float radius, const glm::vec3& color) {
+  Light light;
+  light.position = p;
+  light.radius = radius;
+  light.color = color;
+  light.cos_inner = -1.0f;
+  light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+  light.cos_outer = -1.0f;
+  return light;
+}
+
+Light Light::Spot(const glm::vec3& p, const glm::vec3& dir, float radius,
+                  const glm::vec3& color, float inner_angle,
+                  float outer_angle) {
+  Light light = Point(p, radius, color);
+  light.direction = glm::normalize(dir);
+  light.cos_inner = std::cos(inner_angle);
+  light.cos_outer = std::cos(outer_angle);
+  return light;
+}
+
+std::vector<Light> ScatterLights(unsigned int count, const glm::vec3& lo,
+                                 const glm::vec3& hi, float radius) {
+  std::mt19937 rng(count);
+  std::uniform_real_distribution<float> u(0.0f, 1.0f);
+  std::vector<Light> lights;
+  lights.reserve(count);
+  for (unsigned int i = 0; i < count; ++i) {
+    glm::vec3 p = lo + (hi - lo) * glm::vec3(u(rng), u(rng), u(rng));
+    // saturated colors, so overlapping lights stay apart
+    glm::vec3 color(u(rng), u(rng), u(rng) + 1e-3f);
+    color /= std::max(color.x, std::max(color.y, color.z));
+    if (i % 4 == 3)
+      lights.push_back(Light::Spot(p, glm::vec3(0.0f, -1.0f, 0.0f), radius,
+                                   color, 0.4f, 0.6f));
+    else
+      lights.push_back(Light::Point(p, radius, color));
+  }
+  return lights;
+}
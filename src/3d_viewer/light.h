@@ -0,0 +1,34 @@
+#ifndef _3D_VIEWER_LIGHT_H
+#define _3D_VIEWER_LIGHT_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+/** Point or spot light with a finite range, for the many-light schemes. The
+ * layout is uploaded as is: three vec4 per light.
+ */
+struct Light {
+  glm::vec3 position;
+  float radius;     // the attenuation reaches 0 here
+  glm::vec3 color;  // premultiplied by the intensity
+  float cos_inner;  // spot lights: full intensity inside this cone
+  glm::vec3 direction;
+  float cos_outer;  // spot lights: no light outside this cone, -1 for points
+
+  static Light Point(const glm::vec3& p, float radius, const glm::vec3& color);
+  /** angles are half-angles of the cones, in radians
+   */
+  static Light Spot(const glm::vec3& p, const glm::vec3& dir, float radius,
+                    const glm::vec3& color, float inner_angle,
+                    float outer_angle);
+  bool IsSpot() const { return cos_outer > -1.0f; }
+};
+static_assert(sizeof(Light) == 12 * sizeof(float), "Light must be 3 vec4");
+
+/** count lights at reproducible random places in the box [lo, hi], one in
+ * four a spot light pointing downwards
+ */
+std::vector<Light> ScatterLights(unsigned int count, const glm::vec3& lo,
+                                 const glm::vec3& hi, float radius);
+
+#endif  // _3D_VIEWER_LIGHT_H
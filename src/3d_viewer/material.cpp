@@ -0,0 +1,77 @@
+#include <glad/glad.h>
+
+#include "material.h"
+
+#include "gl_state.h"
+
+const char *Material::SlotName(TextureSlot slot) {
+  static const char *const names[TEXTURE_SLOT_NUM] = {
+      "texture_diffuse", "texture_specular", "texture_normal",
+      "texture_height"};
+  return names[slot];
+}
+
+unsigned int Material::TextureCount() const {
+  unsigned int n = 0;
+  for (int s = 0; s < TEXTURE_SLOT_NUM; ++s) n += textures[s].size();
+  return n;
+}
+
+bool Material::operator==(const Material &other) const {
+  for (int s = 0; s < TEXTURE_SLOT_NUM; ++s)
+    if (textures[s] != other.textures[s]) return false;
+  return diffuse_color == other.diffuse_color &&
+         specular_color == other.specular_color &&
+         shininess == other.shininess && opacity == other.opacity &&
+         alpha_test == other.alpha_test;
+}
+
+unsigned int MaterialLibrary::Intern(const Material &m) {
+  // linear search is fine: materials are interned at import only
+  for (unsigned int i = 0; i < m_materials.size(); ++i)
+    if (m_materials[i] == m) return i;
+  m_materials.push_back(m);
+  m_samplerTables.emplace_back();
+  return m_materials.size() - 1;
+}
+
+void MaterialLibrary::Bind(unsigned int i, const Shader &shader) {
+  GLState &gl_state = GLState::Instance();
+  const std::vector<SamplerBinding> &bindings = samplerBindings(i, shader);
+  for (unsigned int unit = 0; unit < bindings.size(); ++unit) {
+    // a no-op once the program has the sampler set
+    shader.set(bindings[unit].sampler, int(unit));
+    gl_state.BindTexture(unit, GL_TEXTURE_2D, bindings[unit].texture);
+  }
+}
+
+void MaterialLibrary::ForgetShader(unsigned long serial) {
+  for (std::vector<SamplerTable> &tables : m_samplerTables)
+    for (size_t t = 0; t < tables.size(); ++t)
+      if (tables[t].shader == serial) {
+        // order does not matter, move the last table into the hole
+        tables[t] = std::move(tables.back());
+        tables.pop_back();
+        break;
+      }
+}
+
+const std::vector<MaterialLibrary::SamplerBinding> &
+MaterialLibrary::samplerBindings(unsigned int i, const Shader &shader) {
+  std::vector<SamplerTable> &tables = m_samplerTables[i];
+  for (const SamplerTable &table : tables)
+    if (table.shader == shader.Serial()) return table.bindings;
+
+  SamplerTable table;
+  table.shader = shader.Serial();
+  const Material &m = m_materials[i];
+  for (int s = 0; s < Material::TEXTURE_SLOT_NUM; ++s) {
+    std::string name = Material::SlotName(Material::TextureSlot(s));
+    for (unsigned int j = 0; j < m.textures[s].size(); ++j)
+      table.bindings.push_back({shader.GetUniform<int>(name +
+                                                       std::to_string(j + 1)),
+                                m.textures[s][j]});
+  }
+  tables.push_back(std::move(table));
+  return tables.back().bindings;
+}
@@ -0,0 +1,87 @@
+#ifndef _3D_VIEWER_MATERIAL_H
+#define _3D_VIEWER_MATERIAL_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+
+/** Surface description shared by meshes. Textures are grouped by slot; the
+ * i-th texture of a slot is bound to the sampler "<slot name><i+1>", e.g.
+ * texture_diffuse1. Textures are referenced by GL id and owned elsewhere
+ * (see SceneModel::textures_loaded).
+ */
+struct Material {
+  enum TextureSlot { DIFFUSE, SPECULAR, NORMAL, HEIGHT, TEXTURE_SLOT_NUM };
+
+  std::vector<unsigned int> textures[TEXTURE_SLOT_NUM];
+  glm::vec3 diffuse_color = glm::vec3(1.0f);
+  glm::vec3 specular_color = glm::vec3(0.0f);
+  float shininess = 0.0f;
+  float opacity = 1.0f;
+  // discard fragments where the diffuse texture's alpha is below 0.5, in
+  // every pass including depth-only ones
+  bool alpha_test = false;
+
+  // sampler name prefix of a slot, e.g. "texture_diffuse"
+  static const char *SlotName(TextureSlot slot);
+  unsigned int TextureCount() const;
+  bool operator==(const Material &other) const;
+};
+
+/** Interned materials. Equal materials get the same index, so meshes can be
+ * grouped by index and the sampler setup of a material is shared by all its
+ * meshes. Index 0 is the default material, without textures.
+ */
+class MaterialLibrary final {
+ public:
+  static MaterialLibrary &Instance() {
+    static MaterialLibrary library;
+    return library;
+  }
+
+  /** index of the material equal to m, added if there is none
+   */
+  unsigned int Intern(const Material &m);
+  const Material &operator[](unsigned int i) const { return m_materials[i]; }
+  unsigned int Size() const { return m_materials.size(); }
+
+  /** bind the textures of material i to units 0, 1, ... and point the
+   * samplers of shader at them. Texture units are assigned slot by slot, in
+   * slot order. Allocates only the first time a material meets a program.
+   */
+  void Bind(unsigned int i, const Shader &shader);
+  /** drop the sampler tables of a released program, by Shader::Serial()
+   */
+  void ForgetShader(unsigned long serial);
+
+ private:
+  /** a texture unit and the sampler uniform reading it
+   */
+  struct SamplerBinding {
+    UniformHandle<int> sampler;
+    unsigned int texture;
+  };
+  /** sampler bindings of a material, resolved once per program
+   */
+  struct SamplerTable {
+    unsigned long shader;  // Shader::Serial()
+    std::vector<SamplerBinding> bindings;
+  };
+  std::vector<Material> m_materials;
+  // per material, one table per program it was drawn with
+  std::vector<std::vector<SamplerTable>> m_samplerTables;
+
+  const std::vector<SamplerBinding> &samplerBindings(unsigned int i,
+                                                     const Shader &shader);
+
+  MaterialLibrary() : m_materials(1), m_samplerTables(1) {}
+  ~MaterialLibrary() = default;
+  MaterialLibrary(const MaterialLibrary &) = delete;
+  MaterialLibrary(MaterialLibrary &&) = delete;
+  MaterialLibrary &operator=(const MaterialLibrary &) = delete;
+  MaterialLibrary &operator=(MaterialLibrary &&) = delete;
+};
+
+#endif  // _3D_VIEWER_MATERIAL_H
@@ -6,37 +6,49 @@
 #include <assimp/scene.h>
 #include <stb_image.h>
 
+#include <algorithm>
 #include <assimp/Importer.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
 
-void ObjectModel::Draw(Shader &shader) const {
-  // bind appropriate textures
-  unsigned int diffuseNr = 1;
-  unsigned int specularNr = 1;
-  unsigned int normalNr = 1;
-  unsigned int heightNr = 1;
-  for (unsigned int i = 0; i < textures.size(); i++) {
-    glActiveTexture(GL_TEXTURE0 + i);
-
-    // bind texture unit to shader sampler variable
-    //- the N in diffuse_textureN ...
-    std::string N;
-    std::string name = textures[i].type;
-    if (name == "texture_diffuse")
-      N = std::to_string(diffuseNr++);
-    else if (name == "texture_specular")
-      N = std::to_string(specularNr++);
-    else if (name == "texture_normal")
-      N = std::to_string(normalNr++);
-    else if (name == "texture_height")
-      N = std::to_string(heightNr++);
-    //- now set the sampler to the correct texture unit
-    glUniform1i(glGetUniformLocation(shader.ID, (name + N).c_str()), i);
-
-    // bind the texture
-    glBindTexture(GL_TEXTURE_2D, textures[i].id);
+#include "gl_state.h"
+#include "vertex_transform.h"
+
+void ObjectModel::Draw(Shader &shader, DrawPass pass) const {
+  if (!m_instances.empty()) {
+    DrawInstanced(shader, pass);
+    return;
   }
+  unsigned int resources = Resources(pass);
+  // bind the material's textures
+  if (resources & DrawPass::MATERIAL)
+    MaterialLibrary::Instance().Bind(material, shader);
+  drawCall(0, !(resources & DrawPass::ATTRIBUTES));
+}
 
+void ObjectModel::DrawInstanced(Shader &shader, DrawPass pass) const {
+  if (m_instances.empty()) return;
+  unsigned int resources = Resources(pass);
+  if (resources & DrawPass::MATERIAL)
+    MaterialLibrary::Instance().Bind(material, shader);
+  uploadInstances();
+  drawCall(m_instances.size(), !(resources & DrawPass::ATTRIBUTES));
+  // current values of attributes drawn from arrays are undefined afterwards
+  ResetInstanceAttributes();
+}
+
+unsigned int ObjectModel::Resources(DrawPass pass) const {
+  if (Features() & HAS_ALPHA_TEST)
+    return pass.resources | DrawPass::MATERIAL | DrawPass::ATTRIBUTES;
+  return pass.resources;
+}
+
+void ObjectModel::drawCall(unsigned int instance_num,
+                           bool positions_only) const {
   // choose drawing mode due to primitive type
   GLenum draw_mode;
   if (primitive_type == POINTS)
@@ -54,19 +66,157 @@ void ObjectModel::Draw(Shader &shader) const {
     return;
   }
 
-  // draw mesh
-  glBindVertexArray(VAO);
-  if (indices.empty())
-    glDrawArrays(draw_mode, 0, positions.size());
-  else
-    glDrawElements(draw_mode, indices.size(), GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+  // draw mesh. The VAO stays bound: the next draw most likely rebinds it or
+  // another one, and GLState skips the redundant binds.
+  unsigned int index_num = indices.size();
+  if (positions_only && m_depthVAO != 0) {
+    GLState::Instance().BindVertexArray(m_depthVAO);
+    index_num = m_depthIndexCount;
+  } else {
+    GLState::Instance().BindVertexArray(VAO);
+  }
+  if (instance_num == 0) {
+    if (index_num == 0)
+      glDrawArrays(draw_mode, 0, positions.size());
+    else
+      glDrawElements(draw_mode, index_num, GL_UNSIGNED_INT, 0);
+  } else {
+    if (index_num == 0)
+      glDrawArraysInstanced(draw_mode, 0, positions.size(), instance_num);
+    else
+      glDrawElementsInstanced(draw_mode, index_num, GL_UNSIGNED_INT, 0,
+                              instance_num);
+  }
+}
 
-  // set everything back to defaults
-  glActiveTexture(GL_TEXTURE0);
+unsigned int ObjectModel::AddInstance(const glm::mat4 &T) {
+  unsigned int id;
+  if (m_freeInstanceIds.empty()) {
+    id = m_instanceSlots.size();
+    m_instanceSlots.push_back(0);
+  } else {
+    id = m_freeInstanceIds.back();
+    m_freeInstanceIds.pop_back();
+  }
+  m_instanceSlots[id] = m_instances.size();
+  m_instanceIds.push_back(id);
+  m_instances.push_back(T);
+  markDirty(m_instances.size() - 1);
+  return id;
+}
+
+void ObjectModel::RemoveInstance(unsigned int id) {
+  // move the last instance into the hole
+  unsigned int slot = m_instanceSlots[id];
+  unsigned int last = m_instances.size() - 1;
+  if (slot != last) {
+    m_instances[slot] = m_instances[last];
+    m_instanceIds[slot] = m_instanceIds[last];
+    m_instanceSlots[m_instanceIds[slot]] = slot;
+    markDirty(slot);
+  }
+  m_instances.pop_back();
+  m_instanceIds.pop_back();
+  m_instanceSlots[id] = ~0u;
+  m_freeInstanceIds.push_back(id);
+  ++m_instanceVersion;
+  if (m_dirtyEnd > m_instances.size()) m_dirtyEnd = m_instances.size();
+  // drawn without instances again: the attributes must read the identity,
+  // not the stale first slot of the buffer
+  if (m_instances.empty() && m_instanceArrays) {
+    setInstanceArrays(false);
+    ResetInstanceAttributes();
+  }
+}
+
+void ObjectModel::UpdateInstance(unsigned int id, const glm::mat4 &T) {
+  unsigned int slot = m_instanceSlots[id];
+  m_instances[slot] = T;
+  markDirty(slot);
+}
+
+void ObjectModel::markDirty(unsigned int slot) {
+  ++m_instanceVersion;
+  if (m_dirtyBegin >= m_dirtyEnd) {
+    m_dirtyBegin = slot;
+    m_dirtyEnd = slot + 1;
+    return;
+  }
+  if (slot < m_dirtyBegin) m_dirtyBegin = slot;
+  if (slot + 1 > m_dirtyEnd) m_dirtyEnd = slot + 1;
+}
+
+void ObjectModel::uploadInstances() const {
+  // the instance attributes live in the VAO
+  if (VAO == 0) return;
+  if (m_instanceVBO == 0) glGenBuffers(1, &m_instanceVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+  if (!m_instanceArrays) setInstanceArrays(true);
+  if (m_instanceCapacity < m_instances.size()) {
+    // grow geometrically, so that adding instances one by one stays cheap
+    m_instanceCapacity = std::max<unsigned int>(2 * m_instanceCapacity,
+                                                m_instances.size());
+    glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity * sizeof(glm::mat4),
+                 NULL, GL_DYNAMIC_DRAW);
+    m_dirtyBegin = 0;
+    m_dirtyEnd = m_instances.size();
+  }
+  if (m_dirtyBegin < m_dirtyEnd) {
+    glBufferSubData(GL_ARRAY_BUFFER, m_dirtyBegin * sizeof(glm::mat4),
+                    (m_dirtyEnd - m_dirtyBegin) * sizeof(glm::mat4),
+                    &m_instances[m_dirtyBegin]);
+    m_dirtyBegin = m_dirtyEnd = 0;
+  }
+}
+
+void ObjectModel::setInstanceArrays(bool on) const {
+  // both vertex arrays read the instances
+  for (unsigned int vao : {VAO, m_depthVAO}) {
+    if (vao == 0) continue;
+    GLState::Instance().BindVertexArray(vao);
+    // a mat4 attribute takes four consecutive locations, one per column
+    for (unsigned int c = 0; c < 4; ++c) {
+      if (!on) {
+        glDisableVertexAttribArray(6 + c);
+        continue;
+      }
+      glEnableVertexAttribArray(6 + c);
+      glVertexAttribPointer(6 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                            (void *)(c * sizeof(glm::vec4)));
+      glVertexAttribDivisor(6 + c, 1);
+    }
+  }
+  m_instanceArrays = on;
+}
+
+void ObjectModel::ResetInstanceAttributes() {
+  for (unsigned int c = 0; c < 4; ++c)
+    glVertexAttrib4f(6 + c, c == 0, c == 1, c == 2, c == 3);
+}
+
+unsigned int ObjectModel::Features() const {
+  unsigned int features = 0;
+  unsigned int v_num = positions.size();
+  const Material &m = MaterialLibrary::Instance()[material];
+  if (tangents.size() == v_num && bitangents.size() == v_num &&
+      !m.textures[Material::NORMAL].empty())
+    features |= HAS_NORMAL_MAP;
+  if (colors.size() == v_num) features |= HAS_VERTEX_COLOR;
+  if (m.alpha_test && tex_coords.size() == v_num &&
+      !m.textures[Material::DIFFUSE].empty())
+    features |= HAS_ALPHA_TEST;
+  return features;
+}
+
+const std::vector<std::string> &ObjectModel::FeatureDefines() {
+  static const std::vector<std::string> defines = {
+      "HAS_NORMAL_MAP", "HAS_VERTEX_COLOR", "HAS_ALPHA_TEST"};
+  return defines;
 }
 
 void ObjectModel::LoadIntoBuffers() {
+  // the uploaded positions are the ones to bound
+  m_boundsValid = false;
   // compute buffer size
   unsigned int v_num = positions.size();
   unsigned int buf_size = v_num * sizeof(glm::vec3);
@@ -81,7 +231,7 @@ void ObjectModel::LoadIntoBuffers() {
   glGenBuffers(1, &VBO);
   if (!indices.empty()) glGenBuffers(1, &EBO);
 
-  glBindVertexArray(VAO);
+  GLState::Instance().BindVertexArray(VAO);
   // load data into vertex buffers and set the vertex attribute pointers
   glBindBuffer(GL_ARRAY_BUFFER, VBO);
   glBufferData(GL_ARRAY_BUFFER, buf_size, NULL, GL_STATIC_DRAW);
@@ -107,7 +257,7 @@ void ObjectModel::LoadIntoBuffers() {
     glBufferSubData(GL_ARRAY_BUFFER, attr_pos, v_num * sizeof(glm::vec2),
                     tex_coords.data());
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec2),
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2),
                           (void *)attr_pos);
     attr_pos += v_num * sizeof(glm::vec2);
   }
@@ -134,7 +284,7 @@ void ObjectModel::LoadIntoBuffers() {
     glBufferSubData(GL_ARRAY_BUFFER, attr_pos, v_num * sizeof(glm::vec4),
                     colors.data());
     glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec4),
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4),
                           (void *)attr_pos);
     attr_pos += v_num * sizeof(glm::vec4);
   }
@@ -144,27 +294,143 @@ void ObjectModel::LoadIntoBuffers() {
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
                  &indices[0], GL_STATIC_DRAW);
   }
+  loadDepthBuffers();
 
   // unbind VAO
-  glBindVertexArray(0);
+  GLState::Instance().BindVertexArray(0);
+}
+
+// bit pattern of a position, with -0 folded into +0
+struct PositionKey {
+  uint32_t bits[3];
+  explicit PositionKey(const glm::vec3 &p) {
+    for (int i = 0; i < 3; ++i) {
+      float v = p[i] + 0.0f;
+      std::memcpy(&bits[i], &v, sizeof(float));
+    }
+  }
+  bool operator==(const PositionKey &o) const {
+    return bits[0] == o.bits[0] && bits[1] == o.bits[1] && bits[2] == o.bits[2];
+  }
+};
+
+struct PositionKeyHash {
+  size_t operator()(const PositionKey &k) const {
+    uint64_t h = k.bits[0] * 0x9E3779B97F4A7C15ull;
+    h ^= k.bits[1] + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+    h ^= k.bits[2] + 0x8CB92BA72F3D8DD7ull + (h << 6) + (h >> 2);
+    return h;
+  }
+};
+
+void ObjectModel::loadDepthBuffers() {
+  // merge vertices with equal positions
+  unsigned int v_num = positions.size();
+  std::vector<glm::vec3> unique;
+  std::vector<unsigned int> remap(v_num);
+  std::unordered_map<PositionKey, unsigned int, PositionKeyHash> index;
+  index.reserve(v_num);
+  for (unsigned int v = 0; v < v_num; ++v) {
+    auto it = index.emplace(PositionKey(positions[v]), unique.size()).first;
+    if (it->second == unique.size()) unique.push_back(positions[v]);
+    remap[v] = it->second;
+  }
+
+  glGenVertexArrays(1, &m_depthVAO);
+  GLState::Instance().BindVertexArray(m_depthVAO);
+  glEnableVertexAttribArray(0);
+  if (unique.size() == v_num) {
+    // nothing merged, share the positions and indices of the full stream
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+    if (!indices.empty()) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    m_depthIndexCount = indices.size();
+    return;
+  }
+  std::vector<unsigned int> depth_indices;
+  if (indices.empty()) {
+    depth_indices.swap(remap);
+  } else {
+    depth_indices.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+      depth_indices[i] = remap[indices[i]];
+  }
+  glGenBuffers(1, &m_depthVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, m_depthVBO);
+  glBufferData(GL_ARRAY_BUFFER, unique.size() * sizeof(glm::vec3),
+               unique.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+  glGenBuffers(1, &m_depthEBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_depthEBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               depth_indices.size() * sizeof(unsigned int),
+               depth_indices.data(), GL_STATIC_DRAW);
+  m_depthIndexCount = depth_indices.size();
+}
+
+void ObjectModel::updateBounds(bool parallel) const {
+  if (m_boundsValid) return;
+  if (positions.empty())
+    m_boundsMin = m_boundsMax = glm::vec3(0.0f);
+  else
+    ComputeBounds(positions.data(), positions.size(), m_boundsMin,
+                  m_boundsMax, parallel);
+  m_boundsValid = true;
+}
+
+void ObjectModel::UpdateBounds(const std::vector<ObjectModel> &meshes) {
+  // Meshes are handed out one at a time, so a few large ones do not leave
+  // the other threads idle. Only a single mesh is split further by
+  // ComputeBounds; with several, the workers already use all cores.
+  unsigned int threads = std::min<size_t>(std::thread::hardware_concurrency(),
+                                          meshes.size());
+  const bool split = threads <= 1;
+  std::atomic<size_t> next(0);
+  auto work = [&meshes, &next, split]() {
+    for (size_t i = next++; i < meshes.size(); i = next++)
+      meshes[i].updateBounds(split);
+  };
+  std::vector<std::thread> workers;
+  for (unsigned int t = 1; t < threads; ++t) workers.emplace_back(work);
+  work();
+  for (std::thread &w : workers) w.join();
+}
+
+void ObjectModel::SetTransform(const glm::mat4 &T) {
+  m_transform = T;
+  m_normalMatrix = glm::transpose(glm::inverse(glm::mat3(T)));
+  ++m_transformVersion;
 }
 
 void ObjectModel::ReleaseBuffers() {
+  GLState::Instance().ForgetVertexArray(VAO);
+  GLState::Instance().ForgetVertexArray(m_depthVAO);
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
   if (!indices.empty()) glDeleteBuffers(1, &EBO);
+  glDeleteVertexArrays(1, &m_depthVAO);
+  if (m_depthVBO != 0) glDeleteBuffers(1, &m_depthVBO);
+  if (m_depthEBO != 0) glDeleteBuffers(1, &m_depthEBO);
+  m_depthVAO = m_depthVBO = m_depthEBO = 0;
+  if (m_instanceVBO != 0) glDeleteBuffers(1, &m_instanceVBO);
+  m_instanceVBO = 0;
+  m_instanceCapacity = 0;
+  m_instanceArrays = false;
 }
 
 void Transform(std::vector<glm::vec3> &positions,
                std::vector<glm::vec3> &normals, const glm::mat4 &T) {
-  unsigned int N = positions.size();
-  for (unsigned int i = 0; i < N; ++i) {
-    glm::mat3 R(T);
-    normals[i] = R * normals[i];
-    glm::vec4 p(positions[i], 1.0f);
-    p = T * p;
-    positions[i] = glm::vec3(p);
-  }
+  TransformPoints(positions.data(), positions.size(), T);
+  // normals need the inverse transpose under non-uniform scaling
+  TransformVectors(normals.data(), normals.size(),
+                   glm::transpose(glm::inverse(glm::mat3(T))));
+}
+
+void Transform(ObjectModel &mesh, const glm::mat4 &T) {
+  Transform(mesh.positions, mesh.normals, T);
+  glm::mat3 R(T);
+  TransformVectors(mesh.tangents.data(), mesh.tangents.size(), R);
+  TransformVectors(mesh.bitangents.data(), mesh.bitangents.size(), R);
 }
 
 void SceneModel::loadModel(std::string const &path) {
@@ -181,25 +447,68 @@ void SceneModel::loadModel(std::string const &path) {
   }
   // retrieve the directory path of the filepath
   directory = path.substr(0, path.find_last_of('/'));
+  // materials are shared by meshes, load each once
+  m_materials.resize(scene->mNumMaterials);
+  for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+    m_materials[i] = loadMaterial(scene->mMaterials[i]);
 
   // process ASSIMP's root node recursively
-  processNode(scene->mRootNode, scene);
+  processNode(scene->mRootNode, scene, SceneGraph::NONE);
+
+  // load each referenced mesh once, however many nodes place it
+  std::vector<unsigned int> mesh_index(scene->mNumMeshes, ~0u);
+  std::vector<unsigned int> references(scene->mNumMeshes, 0);
+  for (const MeshPlacement &placement : placements)
+    ++references[placement.mesh];
+  for (MeshPlacement &placement : placements) {
+    unsigned int &i = mesh_index[placement.mesh];
+    if (i == ~0u) {
+      i = meshes.size();
+      meshes.push_back(processMesh(scene->mMeshes[placement.mesh]));
+    }
+    placement.instance =
+        references[placement.mesh] > 1 ? meshes[i].AddInstance(glm::mat4(1.0f))
+                                       : ~0u;
+    placement.mesh = i;
+  }
+  UpdateTransforms();
 }
 
 // processes a node in a recursive fashion.
-void SceneModel::processNode(aiNode *node, const aiScene *scene) {
-  // process each mesh located at the current node
-  for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-    aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-    meshes.push_back(processMesh(mesh, scene));
-  }
+void SceneModel::processNode(aiNode *node, const aiScene *scene,
+                             unsigned int parent) {
+  // aiMatrix4x4 is row-major, glm matrices are built from columns
+  const aiMatrix4x4 &m = node->mTransformation;
+  glm::mat4 local(glm::vec4(m.a1, m.b1, m.c1, m.d1),
+                  glm::vec4(m.a2, m.b2, m.c2, m.d2),
+                  glm::vec4(m.a3, m.b3, m.c3, m.d3),
+                  glm::vec4(m.a4, m.b4, m.c4, m.d4));
+  unsigned int n = graph.AddNode(parent, local, node->mName.C_Str());
+  // record each mesh located at the current node
+  for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    placements.push_back({node->mMeshes[i], n, ~0u});
   // recursively process each of the children nodes
   for (unsigned int i = 0; i < node->mNumChildren; i++) {
-    processNode(node->mChildren[i], scene);
+    processNode(node->mChildren[i], scene, n);
   }
 }
 
-ObjectModel SceneModel::processMesh(aiMesh *mesh, const aiScene *scene) {
+unsigned int SceneModel::UpdateTransforms() {
+  unsigned int updated = graph.UpdateWorld();
+  if (updated == 0) return 0;
+  for (const MeshPlacement &placement : placements) {
+    if (!graph.Changed(placement.node)) continue;
+    ObjectModel &mesh = meshes[placement.mesh];
+    const glm::mat4 &world = graph.World(placement.node);
+    if (placement.instance == ~0u)
+      mesh.SetTransform(world);
+    else
+      mesh.UpdateInstance(placement.instance, world);
+  }
+  return updated;
+}
+
+ObjectModel SceneModel::processMesh(aiMesh *mesh) {
   // data to fill
   ObjectModel res;
   res.primitive_type = ObjectModel::TRIANGLES;
@@ -246,36 +555,42 @@ ObjectModel SceneModel::processMesh(aiMesh *mesh, const aiScene *scene) {
     for (unsigned int j = 0; j < face.mNumIndices; j++)
       res.indices.push_back(face.mIndices[j]);
   }
-  // process materials
-  aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+  res.material = m_materials[mesh->mMaterialIndex];
 
+  // load mesh data into GPU buffers
+  res.LoadIntoBuffers();
+  return res;
+}
+
+unsigned int SceneModel::loadMaterial(aiMaterial *mat) {
+  Material material;
   // assume a convention for sampler names in the shaders. Each diffuse
   // texture should be named as 'texture_diffuseN' where N is a sequential
   // number ranging from 1 to MAX_SAMPLER_NUMBER. Same applies to other texture
   // such as : texture_specularN, texture_normalN
-
-  // 1. diffuse maps
-  std::vector<Texture> diffuseMaps =
-      loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-  res.textures.insert(res.textures.end(), diffuseMaps.begin(),
-                      diffuseMaps.end());
-  // 2. specular maps
-  std::vector<Texture> specularMaps = loadMaterialTextures(
-      material, aiTextureType_SPECULAR, "texture_specular");
-  res.textures.insert(res.textures.end(), specularMaps.begin(),
-                      specularMaps.end());
-  // 3. normal maps
-  std::vector<Texture> normalMaps =
-      loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-  res.textures.insert(res.textures.end(), normalMaps.begin(), normalMaps.end());
-  // 4. height maps
-  std::vector<Texture> heightMaps =
-      loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-  res.textures.insert(res.textures.end(), heightMaps.begin(), heightMaps.end());
-
-  // load mesh data into GPU buffers
-  res.LoadIntoBuffers();
-  return res;
+  const aiTextureType types[Material::TEXTURE_SLOT_NUM] = {
+      aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT,
+      aiTextureType_AMBIENT};
+  for (int s = 0; s < Material::TEXTURE_SLOT_NUM; s++) {
+    const char *name = Material::SlotName(Material::TextureSlot(s));
+    for (const Texture &tex : loadMaterialTextures(mat, types[s], name))
+      material.textures[s].push_back(tex.id);
+  }
+  // scalar parameters, defaults are kept if absent
+  aiColor3D color;
+  if (mat->Get(AI_MATKEY_COLOR_DIFFUSE, color) == aiReturn_SUCCESS)
+    material.diffuse_color = glm::vec3(color.r, color.g, color.b);
+  if (mat->Get(AI_MATKEY_COLOR_SPECULAR, color) == aiReturn_SUCCESS)
+    material.specular_color = glm::vec3(color.r, color.g, color.b);
+  mat->Get(AI_MATKEY_SHININESS, material.shininess);
+  mat->Get(AI_MATKEY_OPACITY, material.opacity);
+  // cut-outs such as leaves and fences keep the alpha of the diffuse texture
+  int flags = 0;
+  if (!material.textures[Material::DIFFUSE].empty() &&
+      mat->Get(AI_MATKEY_TEXFLAGS_DIFFUSE(0), flags) == aiReturn_SUCCESS &&
+      (flags & aiTextureFlags_UseAlpha))
+    material.alpha_test = true;
+  return MaterialLibrary::Instance().Intern(material);
 }
 
 // checks all material textures of a given type and loads the textures if
@@ -331,7 +646,7 @@ unsigned int TextureFromFile(const char *path, const std::string &directory,
     else if (nrComponents == 4)
       format = GL_RGBA;
 
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState::Instance().BindTexture(GL_TEXTURE_2D, textureID);
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
                  GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
@@ -351,7 +666,10 @@ unsigned int TextureFromFile(const char *path, const std::string &directory,
   return textureID;
 }
 
-void Texture::Release() { glDeleteTextures(1, &id); }
+void Texture::Release() {
+  GLState::Instance().ForgetTexture(id);
+  glDeleteTextures(1, &id);
+}
 
 const ObjectModel &ObjectModel::UnitCube() {
   static ObjectModel cube;
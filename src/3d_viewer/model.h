@@ -8,6 +8,8 @@
 #include <string>
 #include <vector>
 
+#include "material.h"
+#include "scene_graph.h"
 #include "shader.h"
 
 /** info of texture loaded into GPU memory
@@ -22,9 +24,31 @@ struct Texture {
 unsigned int TextureFromFile(const char *path, const std::string &directory,
                              bool gamma = false);
 
+/** Resources a pass reads from the meshes it draws. Depth-only and ID passes
+ * need neither textures nor vertex attributes besides the position, except
+ * for alpha-tested materials, which always get both.
+ */
+struct DrawPass {
+  enum Resource {
+    MATERIAL = 1 << 0,    // material textures bound to the samplers
+    ATTRIBUTES = 1 << 1,  // all vertex attributes, else positions only
+  };
+  unsigned int resources;
+
+  static DrawPass Shading() { return {MATERIAL | ATTRIBUTES}; }
+  static DrawPass DepthOnly() { return {0}; }
+};
+
 class ObjectModel {
  public:
   enum PrimitiveType { POINTS, LINES, LINE_STRIP, TRIANGLES, TRIANGLE_STRIP };
+  // optional vertex/material features, shader variants are specialized for.
+  // Bit i is enabled by FeatureDefines()[i].
+  enum Feature {
+    HAS_NORMAL_MAP = 1 << 0,
+    HAS_VERTEX_COLOR = 1 << 1,
+    HAS_ALPHA_TEST = 1 << 2
+  };
 
   std::vector<glm::vec3> positions;
   std::vector<glm::vec3> normals;
@@ -33,18 +57,93 @@ class ObjectModel {
   std::vector<glm::vec3> bitangents;
   std::vector<glm::vec4> colors;
   std::vector<unsigned int> indices;
-  std::vector<Texture> textures;
+  unsigned int material;  // index into MaterialLibrary
   PrimitiveType primitive_type;
 
   // constructor
-  ObjectModel() {}
+  ObjectModel()
+      : material(0),
+        VAO(0),
+        VBO(0),
+        EBO(0),
+        m_depthVAO(0),
+        m_depthVBO(0),
+        m_depthEBO(0),
+        m_depthIndexCount(0),
+        m_transform(1.0f),
+        m_normalMatrix(1.0f),
+        m_transformVersion(0),
+        m_boundsValid(false),
+        m_instanceVersion(0),
+        m_instanceVBO(0),
+        m_instanceCapacity(0),
+        m_instanceArrays(false),
+        m_dirtyBegin(0),
+        m_dirtyEnd(0) {}
   // ~Mesh();
   void ReleaseBuffers();
 
-  // one-pass render
-  void Draw(Shader &shader) const;
+  // one-pass render, of all instances if the mesh has any
+  void Draw(Shader &shader, DrawPass pass = DrawPass::Shading()) const;
+  // one draw call for all instances
+  void DrawInstanced(Shader &shader,
+                     DrawPass pass = DrawPass::Shading()) const;
   // Load vertices data into buffers
   void LoadIntoBuffers();
+  /** Vertex array drawn in pass. Without ATTRIBUTES it has just the
+   * position and instance attributes, and vertices split only by other
+   * attributes (e.g. UV seams) are merged.
+   */
+  unsigned int VertexArray(DrawPass pass = DrawPass::Shading()) const {
+    return Resources(pass) & DrawPass::ATTRIBUTES ? VAO : m_depthVAO;
+  }
+  // resources pass reads from this mesh, more than asked if alpha-tested
+  unsigned int Resources(DrawPass pass) const;
+  // mask of Feature the mesh provides
+  unsigned int Features() const;
+  static const std::vector<std::string> &FeatureDefines();
+
+  // model transform applied at draw time. The normal matrix is derived here,
+  // once per change, instead of per vertex in the shaders.
+  void SetTransform(const glm::mat4 &T);
+  const glm::mat4 &GetTransform() const { return m_transform; }
+  const glm::mat3 &GetNormalMatrix() const { return m_normalMatrix; }
+  // incremented by SetTransform, lets renderers detect stale copies
+  unsigned int TransformVersion() const { return m_transformVersion; }
+
+  // axis-aligned bounds of positions in model space, computed on first use
+  // and again after LoadIntoBuffers()
+  const glm::vec3 &BoundsMin() const {
+    updateBounds();
+    return m_boundsMin;
+  }
+  const glm::vec3 &BoundsMax() const {
+    updateBounds();
+    return m_boundsMax;
+  }
+  // compute the bounds of meshes that have none yet, in parallel
+  static void UpdateBounds(const std::vector<ObjectModel> &meshes);
+
+  // Instances: copies of the mesh, each with a transform applied before
+  // GetTransform(). Instance transforms are fed to vertex attributes 6-9 and
+  // must be rigid motions with uniform scale, since normals are transformed
+  // by their upper 3x3. Ids stay valid until removed; the draw order does not.
+  unsigned int AddInstance(const glm::mat4 &T);
+  void RemoveInstance(unsigned int id);
+  void UpdateInstance(unsigned int id, const glm::mat4 &T);
+  const glm::mat4 &GetInstance(unsigned int id) const {
+    return m_instances[m_instanceSlots[id]];
+  }
+  unsigned int InstanceCount() const { return m_instances.size(); }
+  // instance transforms in draw order
+  const std::vector<glm::mat4> &Instances() const { return m_instances; }
+  // incremented by any change of the instances
+  unsigned int InstanceVersion() const { return m_instanceVersion; }
+  /** Set the current value of the instance attributes to the identity, so
+   * that meshes without instances draw with the same shaders. Current
+   * attribute values are context state, call once after context creation.
+   */
+  static void ResetInstanceAttributes();
 
   // Create standard shapes
   //- standard cube [(-1, -1, -1), (1, 1, 1)]
@@ -57,15 +156,61 @@ class ObjectModel {
  private:
   unsigned int VAO;
   unsigned int VBO, EBO;
+  // position-only stream of VertexArray(). The buffers are 0 if no vertices
+  // merge, then the VAO reads positions and indices from VBO and EBO.
+  unsigned int m_depthVAO;
+  unsigned int m_depthVBO, m_depthEBO;
+  unsigned int m_depthIndexCount;  // 0 if drawn without indices
+  void loadDepthBuffers();
+  glm::mat4 m_transform;
+  glm::mat3 m_normalMatrix;
+  unsigned int m_transformVersion;
+  mutable glm::vec3 m_boundsMin, m_boundsMax;
+  mutable bool m_boundsValid;
+  // parallel: may split the vertices across threads, see ComputeBounds
+  void updateBounds(bool parallel = true) const;
+
+  std::vector<glm::mat4> m_instances;
+  std::vector<unsigned int> m_instanceIds;    // slot -> id
+  std::vector<unsigned int> m_instanceSlots;  // id -> slot, ~0u if removed
+  std::vector<unsigned int> m_freeInstanceIds;
+  unsigned int m_instanceVersion;
+  // per-instance vertex buffer, uploaded lazily by the next draw
+  mutable unsigned int m_instanceVBO;
+  mutable unsigned int m_instanceCapacity;
+  // attributes 6-9 of the vertex arrays read m_instanceVBO, else they keep
+  // the identity set by ResetInstanceAttributes()
+  mutable bool m_instanceArrays;
+  mutable unsigned int m_dirtyBegin, m_dirtyEnd;  // slots changed since
+  void markDirty(unsigned int slot);
+  void uploadInstances() const;
+  // enable or disable the instance attribute arrays of both vertex arrays;
+  // enabling expects m_instanceVBO bound to GL_ARRAY_BUFFER
+  void setInstanceArrays(bool on) const;
+  void drawCall(unsigned int instance_num, bool positions_only) const;
 };
 
+// bake T into vertex data, see vertex_transform.h
 void Transform(std::vector<glm::vec3> &positions,
                std::vector<glm::vec3> &normals, const glm::mat4 &T);
+// also transforms tangents and bitangents
+void Transform(ObjectModel &mesh, const glm::mat4 &T);
 
 class SceneModel {
  public:
   std::vector<Texture> textures_loaded;
   std::vector<ObjectModel> meshes;
+  // node hierarchy of the file, empty for models built in code
+  SceneGraph graph;
+  /** a mesh placed by a node. A mesh placed by several nodes is drawn as
+   * instances, one per node; otherwise the node sets the mesh transform.
+   */
+  struct MeshPlacement {
+    unsigned int mesh;
+    unsigned int node;
+    unsigned int instance;  // ObjectModel instance id, ~0u if not instanced
+  };
+  std::vector<MeshPlacement> placements;
 
   SceneModel() : gammaCorrection(false) {}
   // constructor, expects a filepath to a 3D model.
@@ -75,8 +220,9 @@ class SceneModel {
   }
 
   // draws the model, and thus all its meshes
-  void Draw(Shader &shader) const {
-    for (unsigned int i = 0; i < meshes.size(); i++) meshes[i].Draw(shader);
+  void Draw(Shader &shader, DrawPass pass = DrawPass::Shading()) const {
+    for (unsigned int i = 0; i < meshes.size(); i++)
+      meshes[i].Draw(shader, pass);
   }
 
   void ReleaseBuffers() {
@@ -84,6 +230,11 @@ class SceneModel {
     for (Texture &tex : textures_loaded) tex.Release();
   }
 
+  /** propagate changed node transforms (see graph.SetLocal) to the meshes,
+   * returns the number of nodes updated
+   */
+  unsigned int UpdateTransforms();
+
  private:
   std::string directory;
   bool gammaCorrection;
@@ -91,17 +242,22 @@ class SceneModel {
    * resulting meshes in the meshes vector.
    */
   void loadModel(std::string const &path);
-  /** processes a node in a recursive fashion. Processes each individual mesh
-   * located at the node and repeats this process on its children nodes (if
-   * any).
+  /** adds a node below parent to the graph in a recursive fashion, and
+   * records the meshes it places (by scene mesh index). Children are added
+   * after their parent, keeping the graph in topological order.
+   */
+  void processNode(aiNode *node, const aiScene *scene, unsigned int parent);
+  ObjectModel processMesh(aiMesh *mesh);
+  /** textures and parameters of mat, interned into MaterialLibrary
    */
-  void processNode(aiNode *node, const aiScene *scene);
-  ObjectModel processMesh(aiMesh *mesh, const aiScene *scene);
+  unsigned int loadMaterial(aiMaterial *mat);
   /** checks all material textures of a given type and loads the textures if
    * they're not loaded yet. the required info is returned as a Texture struct.
    */
   std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type,
                                             std::string typeName);
+  // MaterialLibrary index of each scene material, filled by loadModel
+  std::vector<unsigned int> m_materials;
 };
 
 class TrackballModel {
@@ -0,0 +1,261 @@
+#include <glad/glad.h>
+
+#include "point_shadow_scheme.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <string>
+
+#include "config.h"
+#include "gl_state.h"
+#include "gl_util.h"
+
+static const std::string& res_dir() { return Config::Instance().shader_dir; }
+
+// smallest |t| over [lo, hi]
+static float MinAbs(float lo, float hi) {
+  return lo > 0.0f ? lo : (hi < 0.0f ? -hi : 0.0f);
+}
+
+/** cube faces, as a bit mask in cube map face order (+X, -X, +Y, -Y, +Z,
+ * -Z), that see some point of the box [lo, hi] given relative to the light,
+ * within range. Face +X sees the points with x >= |y| and x >= |z|, and the
+ * three coordinates can be picked independently within the box.
+ */
+static unsigned int CubeFaces(const glm::vec3& lo, const glm::vec3& hi,
+                              float range) {
+  if (lo.x > hi.x) return 0;  // empty
+  glm::vec3 nearest = glm::clamp(glm::vec3(0.0f), lo, hi);
+  if (glm::dot(nearest, nearest) > range * range) return 0;
+  const glm::vec3 min_abs(MinAbs(lo.x, hi.x), MinAbs(lo.y, hi.y),
+                          MinAbs(lo.z, hi.z));
+  unsigned int faces = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float a = min_abs[(axis + 1) % 3], b = min_abs[(axis + 2) % 3];
+    // farthest extent of the box along the axis, in each direction
+    const float extent[2] = {hi[axis], -lo[axis]};
+    for (int side = 0; side < 2; ++side)
+      if (extent[side] > 0.0f && extent[side] >= a && extent[side] >= b)
+        faces |= 1u << (2 * axis + side);
+  }
+  return faces;
+}
+
+static unsigned int BitCount(unsigned int mask) {
+  unsigned int n = 0;
+  for (; mask; mask &= mask - 1) ++n;
+  return n;
+}
+
+PointLightShadowScheme::PointLightShadowScheme()
+    : shader(res_dir() + "/shadow_rendering.vs", res_dir() + "/point_shadow.fs",
+             ObjectModel::FeatureDefines()),
+      cubeDepthShader(res_dir() + "/point_shadow_depth.vs",
+                      res_dir() + "/depth_mapping.fs",
+                      ObjectModel::FeatureDefines(),
+                      res_dir() + "/point_shadow_depth.gs"),
+      cubeDepthMap(0),
+      m_shadowResolution(1024),
+      m_lightPos(0.0f),
+      m_lightRange(1.0f),
+      m_shadowsValid(false),
+      m_shadowModelSerial(0),
+      m_cubeStats() {
+  glGenFramebuffers(1, &cubeFBO);
+  createShadowMap();
+  CreateTextureBuffer(GL_R8UI, GL_STREAM_DRAW, m_faceMaskTex, m_faceMaskTBO);
+  // the shadow map and the face masks follow the units used by the model's
+  // textures
+  shader.SetInitializer([this](Shader& s) {
+    s.setInt("shadowMap", m_colorTexUnitNum);
+  });
+  cubeDepthShader.SetInitializer([this](Shader& s) {
+    s.setInt("faceMasks", m_colorTexUnitNum);
+  });
+  for (int f = 0; f < 6; ++f)
+    m_faceMatrices[f] = cubeDepthShader.GetUniform<glm::mat4>(
+        "faceMatrices[" + std::to_string(f) + "]");
+  m_lightRangeUniform = shader.GetUniform<glm::vec2>("lightRange");
+  m_shaderVariants = {&shader, &cubeDepthShader};
+}
+
+PointLightShadowScheme::PointLightShadowScheme(const SceneModel* model,
+                                               Navigation* nav)
+    : PointLightShadowScheme() {
+  SetModel(model);
+  SetNavigation(nav);
+  InitNavigationFromBBox();
+  // a light in the upper part of the scene, reaching all of it
+  glm::vec3 p1 = BBoxMin(), p2 = BBoxMax();
+  SetLight(m_bboxCenter + glm::vec3(0.0f, 0.25f * (p2.y - p1.y), 0.0f),
+           glm::length(p2 - p1));
+
+  std::cout << "light pos: " << m_lightPos << std::endl;
+  std::cout << "light range: " << m_lightRange << std::endl;
+}
+
+PointLightShadowScheme::~PointLightShadowScheme() {
+  GLState& gl_state = GLState::Instance();
+  releaseShadowMap();
+  gl_state.ForgetFramebuffer(cubeFBO);
+  glDeleteFramebuffers(1, &cubeFBO);
+  DeleteTextureBuffer(m_faceMaskTex, m_faceMaskTBO);
+  shader.Release();
+  cubeDepthShader.Release();
+  m_shadowTimer.Release();
+  m_lightingTimer.Release();
+}
+
+void PointLightShadowScheme::SetShadowResolution(unsigned int resolution) {
+  if (resolution == m_shadowResolution) return;
+  m_shadowResolution = resolution;
+  releaseShadowMap();
+  createShadowMap();
+  InvalidateShadows();
+}
+
+void PointLightShadowScheme::createShadowMap() {
+  GLState& gl_state = GLState::Instance();
+  glGenTextures(1, &cubeDepthMap);
+  gl_state.BindTexture(GL_TEXTURE_CUBE_MAP, cubeDepthMap);
+  for (unsigned int face = 0; face < 6; ++face)
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0,
+                 GL_DEPTH_COMPONENT32F, m_shadowResolution, m_shadowResolution,
+                 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  // bilinear depth comparisons by a shadow sampler, filtered across faces
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  // layered: gl_Layer of the geometry shader selects the face
+  gl_state.BindFramebuffer(cubeFBO);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubeDepthMap, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "cube shadow framebuffer is not complete" << std::endl;
+  gl_state.BindFramebuffer(0);
+}
+
+void PointLightShadowScheme::releaseShadowMap() {
+  GLState::Instance().ForgetTexture(cubeDepthMap);
+  glDeleteTextures(1, &cubeDepthMap);
+  cubeDepthMap = 0;
+}
+
+void PointLightShadowScheme::Render() {
+  GLState& gl_state = GLState::Instance();
+  GLint viewport_old[4];
+  std::copy(gl_state.Viewport(), gl_state.Viewport() + 4, viewport_old);
+  const GLint width = viewport_old[2], height = viewport_old[3];
+  Camera& cam = m_navigation->camera();
+  glm::mat4 projection =
+      glm::perspective(glm::radians(cam.Zoom), (float)width / (float)height,
+                       cam.near_plane, cam.far_plane);
+  const glm::mat4 view = cam.GetViewMatrix();
+
+  // 0. find the faces each caster reaches, if the cube map is stale
+  // --------------------------------------------------------------
+  const std::vector<ObjectModel>& meshes = m_model->meshes;
+  UpdateWorldBounds();
+  if (m_shadowModelSerial != m_modelSerial) {
+    m_shadowModelSerial = m_modelSerial;
+    m_casterVersions.assign(meshes.size(), ~uint64_t(0));
+    m_faceMasks.resize(meshes.size());
+    m_casterVisible.resize(meshes.size());
+  }
+  for (unsigned int j = 0; j < meshes.size(); ++j) {
+    uint64_t version = (uint64_t)meshes[j].TransformVersion() << 32 |
+                       meshes[j].InstanceVersion();
+    if (m_casterVersions[j] == version) continue;
+    m_casterVersions[j] = version;
+    m_shadowsValid = false;
+  }
+  const bool draw_shadows = !m_shadowsValid;
+  const float light_near = lightNear(), light_far = m_lightRange;
+  m_renderQueue.Clear();
+  m_cubeStats = CubeStats();
+  if (draw_shadows) {
+    unsigned int faces = 0;
+    for (unsigned int j = 0; j < meshes.size(); ++j) {
+      unsigned int mask = CubeFaces(m_worldMin[j] - m_lightPos,
+                                    m_worldMax[j] - m_lightPos, m_lightRange);
+      m_faceMasks[j] = mask;
+      m_casterVisible[j] = mask != 0;
+      faces |= mask;
+      m_cubeStats.drawn += BitCount(mask);
+      m_cubeStats.culled += 6 - BitCount(mask);
+    }
+    m_cubeStats.faces = BitCount(faces);
+    UploadBuffer(m_faceMaskTBO, GL_STREAM_DRAW, m_faceMasks.data(),
+                 m_faceMasks.size());
+    // keyed by the distance along -z, any order draws the same cube map
+    SubmitModel(RenderQueue::ShadowPass(0), cubeDepthShader,
+                glm::translate(glm::mat4(1.0f), -m_lightPos), light_near,
+                light_far, &m_casterVisible, ObjectModel::HAS_ALPHA_TEST);
+  }
+  SubmitModel(RenderQueue::OPAQUE, shader, view, cam.near_plane,
+              cam.far_plane);
+  m_renderQueue.Sort();
+  // upload the uniform blocks once, for all programs
+  FrameUniforms frame;
+  frame.projection = projection;
+  frame.view = view;
+  frame.viewPos = glm::vec4(cam.Position(), 1.0f);
+  m_frameBlock.Bind();
+  m_frameBlock.Update(frame);
+  LightUniforms light = LightUniforms();
+  light.lightPos = glm::vec4(m_lightPos, 1.0f);
+  m_lightBlock.Bind();
+  m_lightBlock.Update(light);
+  UpdateObjectBlock();
+
+  // 1. render the depth of the casters to all faces of the cube map at once
+  // --------------------------------------------------------------
+  m_shadowTimer.Begin();
+  if (draw_shadows) {
+    // cube map face order: looking down +X, -X, +Y, -Y, +Z, -Z
+    static const glm::vec3 directions[6] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0},
+                                            {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+    static const glm::vec3 ups[6] = {{0, -1, 0}, {0, -1, 0}, {0, 0, 1},
+                                     {0, 0, -1}, {0, -1, 0}, {0, -1, 0}};
+    const glm::mat4 face_projection =
+        glm::perspective(glm::radians(90.0f), 1.0f, light_near, light_far);
+    for (int f = 0; f < 6; ++f)
+      cubeDepthShader.set(
+          m_faceMatrices[f],
+          face_projection *
+              glm::lookAt(m_lightPos, m_lightPos + directions[f], ups[f]));
+    const GLint res = m_shadowResolution;
+    gl_state.Viewport(0, 0, res, res);
+    gl_state.BindFramebuffer(cubeFBO);
+    glEnable(GL_DEPTH_TEST);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    gl_state.BindTexture(m_colorTexUnitNum, GL_TEXTURE_BUFFER, m_faceMaskTex);
+    m_renderQueue.Draw(RenderQueue::ShadowPass(0), &m_objectBlock);
+    gl_state.BindFramebuffer(0);
+    gl_state.Viewport(viewport_old[0], viewport_old[1], viewport_old[2],
+                      viewport_old[3]);
+    m_shadowsValid = true;
+  }
+  m_shadowTimer.End();
+
+  // 2. render the scene lit by the light, reading the cube map
+  // --------------------------------------------------------------
+  const glm::vec2 light_range(light_near, light_far);
+  shader.set(m_lightRangeUniform, light_range);
+  glEnable(GL_DEPTH_TEST);
+  glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  gl_state.BindTexture(m_colorTexUnitNum, GL_TEXTURE_CUBE_MAP, cubeDepthMap);
+  m_lightingTimer.Begin();
+  m_renderQueue.Draw(RenderQueue::OPAQUE, &m_objectBlock);
+  m_lightingTimer.End();
+}
@@ -0,0 +1,78 @@
+#ifndef _3D_VIEWER_POINT_SHADOW_SCHEME_H
+#define _3D_VIEWER_POINT_SHADOW_SCHEME_H
+
+#include <cstdint>
+#include <vector>
+
+#include "rendering_scheme.h"
+
+/** One point light with omnidirectional shadows. The six faces of the cube
+ * shadow map are rendered in a single pass: a geometry shader sends each
+ * triangle to the layers of the faces it can be seen in. The faces a mesh
+ * casts into are found on the CPU from its world bounds and reach the
+ * geometry shader as a texture buffer, one bit per face; meshes reaching no
+ * face, e.g. out of the light's range, are not drawn at all.
+ *
+ * The cube map is only re-rendered when the light or a caster moved.
+ */
+class PointLightShadowScheme : public RenderingScheme {
+ public:
+  PointLightShadowScheme();
+  PointLightShadowScheme(const SceneModel*, Navigation*);
+  ~PointLightShadowScheme();
+  // the light reaches, and casts shadows up to, range
+  void SetLight(const glm::vec3& p, float range) {
+    m_lightPos = p;
+    m_lightRange = range;
+    InvalidateShadows();
+  }
+  const glm::vec3& GetLightPos() const { return m_lightPos; }
+  float GetLightRange() const { return m_lightRange; }
+  // resolution x resolution texels per cube face
+  void SetShadowResolution(unsigned int resolution);
+  /** re-render the cube map in the next frame, for changes the scheme
+   * cannot see, e.g. edited vertices
+   */
+  void InvalidateShadows() { m_shadowsValid = false; }
+  virtual void Render() override;
+  virtual TimerList Timers() override {
+    return {{"shadow cube", &m_shadowTimer}, {"lit pass", &m_lightingTimer}};
+  }
+
+  /** culling of the last cube map rendered, all zero in frames reusing it
+   */
+  struct CubeStats {
+    unsigned int faces;   // faces with at least one caster
+    unsigned int drawn;   // mesh-face pairs rendered
+    unsigned int culled;  // mesh-face pairs skipped
+  };
+  const CubeStats& GetCubeStats() const { return m_cubeStats; }
+
+ private:
+  ShaderVariants shader;
+  ShaderVariants cubeDepthShader;  // only alpha testing needs a variant
+  VariantUniform<glm::mat4> m_faceMatrices[6];
+  VariantUniform<glm::vec2> m_lightRangeUniform;
+  unsigned int cubeFBO;
+  unsigned int cubeDepthMap;
+  unsigned int m_shadowResolution;
+  // face mask of each mesh, as a texture buffer
+  unsigned int m_faceMaskTex, m_faceMaskTBO;
+  std::vector<unsigned char> m_faceMasks;
+  std::vector<unsigned char> m_casterVisible;
+  glm::vec3 m_lightPos;
+  float m_lightRange;
+  // the cube map is up to date with the light and these world bounds
+  bool m_shadowsValid;
+  unsigned int m_shadowModelSerial;
+  std::vector<uint64_t> m_casterVersions;
+  CubeStats m_cubeStats;
+  GpuTimer m_shadowTimer, m_lightingTimer;
+
+  void createShadowMap();
+  void releaseShadowMap();
+  // near plane of the cube faces
+  float lightNear() const { return 1e-3f * m_lightRange; }
+};
+
+#endif  // _3D_VIEWER_POINT_SHADOW_SCHEME_H
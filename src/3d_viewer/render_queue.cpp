@@ -0,0 +1,86 @@
+#include <glad/glad.h>
+
+#include "render_queue.h"
+
+#include <cstring>
+
+uint64_t RenderQueue::MakeKey(Pass pass, unsigned int program,
+                              unsigned int material, unsigned int vao,
+                              float depth, bool front_to_back) {
+  // quantize depth into 24 bits, clamped to [0, 1]
+  if (!(depth > 0.0f)) depth = 0.0f;
+  if (depth > 1.0f) depth = 1.0f;
+  uint64_t d = static_cast<uint64_t>(depth * 0xFFFFFF);
+  if (pass == TRANSLUCENT) d = 0xFFFFFF - d;
+
+  uint64_t state = 0;
+  state |= (static_cast<uint64_t>(program) & 0xFF) << 28;
+  state |= (static_cast<uint64_t>(material) & 0xFFFF) << 12;
+  state |= static_cast<uint64_t>(vao) & 0xFFF;
+  uint64_t key = (static_cast<uint64_t>(pass) & 0xF) << 60;
+  if (front_to_back)
+    key |= d << 36 | state;
+  else
+    key |= state << 24 | d;
+  return key;
+}
+
+void RenderQueue::Submit(Pass pass, Shader &shader, const ObjectModel &mesh,
+                         unsigned int object, float depth) {
+  DrawItem item;
+  // meshes drawn without their material are not grouped by it
+  DrawPass resources = Resources(pass);
+  unsigned int material =
+      mesh.Resources(resources) & DrawPass::MATERIAL ? mesh.material : 0;
+  bool front_to_back = pass == DEPTH || pass == TRANSLUCENT ||
+                       (pass == OPAQUE && m_frontToBack);
+  item.key = MakeKey(pass, shader.ID, material, mesh.VertexArray(resources),
+                     depth, front_to_back);
+  item.shader = &shader;
+  item.mesh = &mesh;
+  item.object = object;
+  m_items.push_back(item);
+}
+
+void RenderQueue::Sort() {
+  const size_t N = m_items.size();
+  if (N < 2) return;
+  m_scratch.resize(N);
+
+  DrawItem *src = m_items.data();
+  DrawItem *dst = m_scratch.data();
+  size_t count[256];
+  for (int shift = 0; shift < 64; shift += 8) {
+    std::memset(count, 0, sizeof(count));
+    for (size_t i = 0; i < N; ++i) ++count[(src[i].key >> shift) & 0xFF];
+    // skip the pass if every key shares this byte
+    if (count[(src[0].key >> shift) & 0xFF] == N) continue;
+    // exclusive prefix sum
+    size_t sum = 0;
+    for (int b = 0; b < 256; ++b) {
+      size_t c = count[b];
+      count[b] = sum;
+      sum += c;
+    }
+    for (size_t i = 0; i < N; ++i)
+      dst[count[(src[i].key >> shift) & 0xFF]++] = src[i];
+    std::swap(src, dst);
+  }
+  if (src != m_items.data()) m_items.swap(m_scratch);
+}
+
+void RenderQueue::Draw(Pass pass, const ObjectUniformBuffer *objects) const {
+  const DrawPass resources = Resources(pass);
+  const Shader *current = nullptr;
+  for (const DrawItem &item : m_items) {
+    Pass item_pass = static_cast<Pass>(item.key >> 60);
+    if (item_pass < pass) continue;
+    if (item_pass > pass) break;
+    if (item.shader != current) {
+      current = item.shader;
+      current->use();
+    }
+    if (objects) objects->Bind(item.object);
+    item.mesh->Draw(*item.shader, resources);
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef _3D_VIEWER_RENDER_QUEUE_H
+#define _3D_VIEWER_RENDER_QUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "model.h"
+#include "shader.h"
+#include "uniform_buffer.h"
+
+/** a single draw call waiting in the render queue
+ */
+struct DrawItem {
+  uint64_t key;
+  Shader *shader;
+  const ObjectModel *mesh;
+  unsigned int object;  // slot in the ObjectUniformBuffer
+};
+
+/** Collects the draw calls of a frame and sorts them by a 64-bit state key,
+ * so that draws sharing program, textures and VAO are issued back to back.
+ *
+ * Key layout of the passes sorted by depth, most significant bits first:
+ *   | pass (4) | depth (24) | program (8) | material (16) | VAO (12) |
+ * Depth is stored ascending (front-to-back, for early-Z) except in the
+ * translucent pass, which stores it inverted (back-to-front). The depth
+ * prepass, the opaque pass and the translucent pass are sorted this way.
+ * The other passes, and the opaque pass with SetFrontToBack(false), are
+ * state-sorted instead:
+ *   | pass (4) | program (8) | material (16) | VAO (12) | depth (24) |
+ * where depth only orders the draws sharing a program, material and VAO.
+ * That saves state changes, but costs overdraw without a depth prepass.
+ */
+class RenderQueue {
+ public:
+  // SHADOW + i, i < SHADOW_LAYERS, are the passes of the shadow maps, e.g.
+  // one per cascade and kind of caster
+  enum Pass {
+    SHADOW = 0,
+    DEPTH = 8,  // depth prepass of the camera view
+    OPAQUE = 9,
+    TRANSLUCENT = 10,
+    OVERLAY = 11
+  };
+  static const unsigned int SHADOW_LAYERS = DEPTH - SHADOW;
+  static Pass ShadowPass(unsigned int layer) {
+    return static_cast<Pass>(SHADOW + layer);
+  }
+  // resources the meshes of a pass are drawn with
+  static DrawPass Resources(Pass pass) {
+    return pass < OPAQUE ? DrawPass::DepthOnly() : DrawPass::Shading();
+  }
+
+  /** depth is the normalized view distance in [0, 1]
+   */
+  static uint64_t MakeKey(Pass pass, unsigned int program,
+                          unsigned int material, unsigned int vao,
+                          float depth, bool front_to_back = false);
+
+  RenderQueue() : m_frontToBack(true) {}
+  // sort the opaque pass by depth before state, the default; see the key
+  // layout
+  void SetFrontToBack(bool on) { m_frontToBack = on; }
+
+  void Clear() { m_items.clear(); }
+  void Submit(Pass pass, Shader &shader, const ObjectModel &mesh,
+              unsigned int object, float depth);
+  /** LSD radix sort of the submitted items by key
+   */
+  void Sort();
+  /** issue the draw calls of one pass in sorted order. Per-pass uniforms
+   * must already be set on the shaders used by the pass. Each draw binds its
+   * slot of objects, if given.
+   */
+  void Draw(Pass pass, const ObjectUniformBuffer *objects = nullptr) const;
+
+  const std::vector<DrawItem> &Items() const { return m_items; }
+
+ private:
+  std::vector<DrawItem> m_items;
+  std::vector<DrawItem> m_scratch;  // reused across frames by Sort()
+  bool m_frontToBack;
+};
+
+#endif  // _3D_VIEWER_RENDER_QUEUE_H
@@ -2,42 +2,149 @@
 
 #include "rendering_scheme.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 #include "config.h"
+#include "gl_state.h"
 #include "glm/geometric.hpp"
 
 inline const std::string& res_dir() { return Config::Instance().shader_dir; }
 
+// grow [lo, hi] by the bounds of mesh placed with T
+static void ExtendBox(glm::vec3& lo, glm::vec3& hi, const ObjectModel& mesh,
+                      const glm::mat4& T) {
+  const glm::vec3& b0 = mesh.BoundsMin();
+  const glm::vec3& b1 = mesh.BoundsMax();
+  for (int c = 0; c < 8; ++c) {
+    glm::vec3 p(T * glm::vec4(c & 1 ? b1.x : b0.x, c & 2 ? b1.y : b0.y,
+                              c & 4 ? b1.z : b0.z, 1.0f));
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+}
+
+// a caster that has not moved for this many frames goes back to the cached
+// static shadow map
+static const unsigned long STATIC_CASTER_FRAMES = 60;
+
+// depth texture array of layers resolution x resolution shadow maps
+static unsigned int CreateDepthArray(unsigned int resolution,
+                                     unsigned int layers) {
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  GLState::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution,
+               resolution, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  float borderColor[] = {1.0, 1.0, 1.0, 1.0};
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+  return texture;
+}
+
+// EVSM warping exponents, keep in sync with the EVSM_* defines of the shaders
+static const float EVSM_POSITIVE = 40.0f, EVSM_NEGATIVE = 5.0f;
+
+// RGBA32F texture array of EVSM moments, reading as lit outside its area
+static unsigned int CreateMomentsArray(unsigned int resolution,
+                                       unsigned int layers) {
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  GLState::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, resolution, resolution,
+               layers, 0, GL_RGBA, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  // moments of depth 1
+  float pos = std::exp(EVSM_POSITIVE), neg = -std::exp(-EVSM_NEGATIVE);
+  float borderColor[] = {pos, pos * pos, neg, neg * neg};
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+  return texture;
+}
+
+static void DeleteTexture(unsigned int& texture) {
+  if (texture == 0) return;
+  GLState::Instance().ForgetTexture(texture);
+  glDeleteTextures(1, &texture);
+  texture = 0;
+}
+
+RenderingScheme::RenderingScheme() : m_model(nullptr), m_modelSerial(0) {
+  m_frameBlock.Create(FRAME_BLOCK, sizeof(FrameUniforms));
+  m_lightBlock.Create(LIGHT_BLOCK, sizeof(LightUniforms));
+}
+
+RenderingScheme::~RenderingScheme() {
+  m_frameBlock.Release();
+  m_lightBlock.Release();
+  if (m_objectBlock.Capacity() > 0) m_objectBlock.Release();
+}
+
 DirectionalLightingShadowScheme::DirectionalLightingShadowScheme()
-    : shader((res_dir() + "/shadow_rendering.vs").c_str(),
-             (res_dir() + "/shadow_rendering.fs").c_str()),
-      simpleDepthShader((res_dir() + "/depth_mapping.vs").c_str(),
-                        (res_dir() + "/depth_mapping.fs").c_str()),
+    : shader(res_dir() + "/shadow_rendering.vs",
+             res_dir() + "/shadow_rendering.fs", ObjectModel::FeatureDefines()),
+      simpleDepthShader(res_dir() + "/depth_mapping.vs",
+                        res_dir() + "/depth_mapping.fs",
+                        ObjectModel::FeatureDefines()),
+      depthPrepassShader(res_dir() + "/depth_prepass.vs",
+                         res_dir() + "/depth_mapping.fs",
+                         ObjectModel::FeatureDefines()),
       uniColorShader((res_dir() + "/point.vs").c_str(),
                      (res_dir() + "/uniform_color.fs").c_str()),
-      SHADOW_WIDTH(1024),
-      SHADOW_HEIGHT(1024) {
-  // configure depth map FBO
+      evsmConvertShader((res_dir() + "/fullscreen.vs").c_str(),
+                        (res_dir() + "/evsm_convert.fs").c_str()),
+      evsmBlurShader((res_dir() + "/fullscreen.vs").c_str(),
+                     (res_dir() + "/evsm_blur.fs").c_str()),
+      depthMap(0),
+      staticDepthMap(0),
+      evsmMoments(0),
+      evsmTemp(0),
+      m_evsmDownsample(2),
+      m_shadowFilter(PCF_GRID),
+      m_depthPrepass(false),
+      m_cascadeCount(MAX_CASCADES),
+      m_shadowResolution(2048),
+      m_cascadeSplitLambda(0.75f),
+      m_lightNearPlane(0.0f),
+      m_lightFarPlane(1.0f),
+      m_shadowModelSerial(0),
+      m_frame(0),
+      m_staticShadowsDirty(true),
+      m_dynamicShadowsDirty(true),
+      m_shadowStats(),
+      m_pcfKernel(1) {
+  // configure depth map FBOs, the cascade layers are attached when rendered
   glGenFramebuffers(1, &depthMapFBO);
-  // create depth texture
-  glGenTextures(1, &depthMap);
-  glBindTexture(GL_TEXTURE_2D, depthMap);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH,
-               SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-  float borderColor[] = {1.0, 1.0, 1.0, 1.0};
-  glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-  // attach depth texture as FBO's depth buffer
-  glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
-                         depthMap, 0);
-  glDrawBuffer(GL_NONE);
-  glReadBuffer(GL_NONE);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glGenFramebuffers(1, &staticDepthMapFBO);
+  GLState& gl_state = GLState::Instance();
+  for (unsigned int fbo : {depthMapFBO, staticDepthMapFBO}) {
+    gl_state.BindFramebuffer(fbo);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+  }
+  glGenFramebuffers(1, &evsmFBO);
+  gl_state.BindFramebuffer(0);
+  glGenVertexArrays(1, &m_emptyVAO);
+  m_evsmLayer = evsmConvertShader.GetUniform<int>("layer");
+  m_evsmDownsampleUniform = evsmConvertShader.GetUniform<int>("downsample");
+  m_blurLayer = evsmBlurShader.GetUniform<int>("layer");
+  m_blurDirection = evsmBlurShader.GetUniform<glm::vec2>("direction");
+  m_depthCascade = simpleDepthShader.GetUniform<int>("cascade");
+  createShadowMap();
+
+  // the shadow map follows the units used by the model's textures
+  shader.SetInitializer([this](Shader& s) {
+    s.setInt("shadowMap", m_colorTexUnitNum);
+  });
+  m_shaders = {&uniColorShader, &evsmConvertShader, &evsmBlurShader};
+  m_shaderVariants = {&shader, &simpleDepthShader, &depthPrepassShader};
 }
 
 DirectionalLightingShadowScheme::DirectionalLightingShadowScheme(
@@ -52,87 +159,409 @@ DirectionalLightingShadowScheme::DirectionalLightingShadowScheme(
   glm::vec3 d1 = 0.5f * (p2 - p1);
   glm::vec3 d2 = glm::vec3(d1.x + d1.y + d1.z) - d1;
   m_lightPos = p2 + 0.5f * d2;
-  m_lightNearPlane = norm(m_lightPos - p2);
-  m_lightFarPlane = norm(m_lightPos - p1);
-  m_lightRadius = 0.51 * norm(p2 - p1);
   m_lightDirection = glm::normalize(m_bboxCenter - m_lightPos);
 
-  std::cout << "p1: " << p1 << std::endl;
-  std::cout << "p2: " << p2 << std::endl;
   std::cout << "light pos: " << m_lightPos << std::endl;
-  std::cout << "light far plane: " << m_lightFarPlane << std::endl;
-  std::cout << "light near plane: " << m_lightNearPlane << std::endl;
   std::cout << "light direction: " << m_lightDirection << std::endl;
-  std::cout << "light radius: " << m_lightRadius << std::endl;
 }
 
 DirectionalLightingShadowScheme::~DirectionalLightingShadowScheme() {
+  GLState::Instance().ForgetFramebuffer(depthMapFBO);
+  GLState::Instance().ForgetFramebuffer(staticDepthMapFBO);
+  GLState::Instance().ForgetFramebuffer(evsmFBO);
+  GLState::Instance().ForgetVertexArray(m_emptyVAO);
   glDeleteFramebuffers(1, &depthMapFBO);
-  glDeleteTextures(1, &depthMap);
+  glDeleteFramebuffers(1, &staticDepthMapFBO);
+  glDeleteFramebuffers(1, &evsmFBO);
+  glDeleteVertexArrays(1, &m_emptyVAO);
+  releaseShadowMap();
   m_trackball.ReleaseBuffers();
   simpleDepthShader.Release();
+  depthPrepassShader.Release();
   shader.Release();
   uniColorShader.Release();
+  evsmConvertShader.Release();
+  evsmBlurShader.Release();
+  m_prepassTimer.Release();
+  m_shadowTimer.Release();
+  m_lightingTimer.Release();
+}
+
+const char* DirectionalLightingShadowScheme::ShadowFilterName(
+    ShadowFilter filter) {
+  static const char* names[SHADOW_FILTER_NUM] = {"pcf", "hardware", "poisson",
+                                                 "evsm"};
+  return names[filter];
+}
+
+void DirectionalLightingShadowScheme::SetShadowFilter(ShadowFilter filter) {
+  if (filter == m_shadowFilter) return;
+  m_shadowFilter = filter;
+  applyShadowFilter();
+}
+
+void DirectionalLightingShadowScheme::applyShadowFilter() {
+  // the hardware filter compares in the sampler, with bilinear weights
+  bool compare = m_shadowFilter == PCF_HARDWARE;
+  GLState::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, depthMap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+                  compare ? GL_COMPARE_REF_TO_TEXTURE : GL_NONE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+  // the moments exist only while filtering with EVSM
+  if (m_shadowFilter == EVSM && evsmMoments == 0) {
+    unsigned int size = std::max(1u, m_shadowResolution / m_evsmDownsample);
+    evsmMoments = CreateMomentsArray(size, MAX_CASCADES);
+    evsmTemp = CreateMomentsArray(size, 1);
+  } else if (m_shadowFilter != EVSM) {
+    DeleteTexture(evsmMoments);
+    DeleteTexture(evsmTemp);
+  }
+  shader.SetDefines({"PCF_KERNEL " + std::to_string(m_pcfKernel),
+                     "SHADOW_FILTER " + std::to_string(m_shadowFilter)});
+  // the EVSM moments of cached layers are missing
+  InvalidateShadows();
+}
+
+void DirectionalLightingShadowScheme::filterEvsm(unsigned int layer) {
+  GLState& gl_state = GLState::Instance();
+  const GLint size = std::max(1u, m_shadowResolution / m_evsmDownsample);
+  gl_state.Viewport(0, 0, size, size);
+  gl_state.BindFramebuffer(evsmFBO);
+  gl_state.BindVertexArray(m_emptyVAO);
+  // warp the depths and average them down to the moments resolution
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, evsmMoments,
+                            0, layer);
+  evsmConvertShader.use();
+  evsmConvertShader.set(m_evsmLayer, (int)layer);
+  evsmConvertShader.set(m_evsmDownsampleUniform, (int)m_evsmDownsample);
+  gl_state.BindTexture(0, GL_TEXTURE_2D_ARRAY, depthMap);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  // separable blur, horizontally into evsmTemp and vertically back
+  evsmBlurShader.use();
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, evsmTemp, 0,
+                            0);
+  evsmBlurShader.set(m_blurLayer, (int)layer);
+  evsmBlurShader.set(m_blurDirection, glm::vec2(1.0f, 0.0f));
+  gl_state.BindTexture(0, GL_TEXTURE_2D_ARRAY, evsmMoments);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, evsmMoments,
+                            0, layer);
+  evsmBlurShader.set(m_blurLayer, 0);
+  evsmBlurShader.set(m_blurDirection, glm::vec2(0.0f, 1.0f));
+  gl_state.BindTexture(0, GL_TEXTURE_2D_ARRAY, evsmTemp);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void DirectionalLightingShadowScheme::SetShadowCascades(
+    unsigned int count, unsigned int resolution, float lambda) {
+  m_cascadeCount = std::max(1u, std::min(count, (unsigned int)MAX_CASCADES));
+  m_cascadeSplitLambda = lambda;
+  InvalidateShadows();
+  if (resolution == m_shadowResolution) return;
+  m_shadowResolution = resolution;
+  releaseShadowMap();
+  createShadowMap();
+}
+
+void DirectionalLightingShadowScheme::InvalidateShadows() {
+  for (CascadeCache& cache : m_cascadeCache) cache.valid = false;
+}
+
+void DirectionalLightingShadowScheme::createShadowMap() {
+  // one layer per possible cascade, so the count can change without
+  // reallocating
+  depthMap = CreateDepthArray(m_shadowResolution, MAX_CASCADES);
+  staticDepthMap = CreateDepthArray(m_shadowResolution, MAX_CASCADES);
+  applyShadowFilter();
+}
+
+void DirectionalLightingShadowScheme::releaseShadowMap() {
+  DeleteTexture(depthMap);
+  DeleteTexture(staticDepthMap);
+  DeleteTexture(evsmMoments);
+  DeleteTexture(evsmTemp);
+}
+
+void DirectionalLightingShadowScheme::updateShadowCasters() {
+  unsigned int n = m_model->meshes.size();
+  ++m_frame;
+  if (m_shadowModelSerial != m_modelSerial) {
+    // new scene, every caster starts as static
+    m_shadowModelSerial = m_modelSerial;
+    m_casterVersions = m_worldBoundsVersions;
+    m_casterMoved.assign(n, 0);
+    m_casterDynamic.assign(n, 0);
+    InvalidateShadows();
+    return;
+  }
+  for (unsigned int i = 0; i < n; ++i) {
+    if (m_casterVersions[i] != m_worldBoundsVersions[i]) {
+      m_casterVersions[i] = m_worldBoundsVersions[i];
+      m_casterMoved[i] = m_frame;
+      // a static caster that starts moving leaves the cached map
+      if (!m_casterDynamic[i]) m_staticShadowsDirty = true;
+      m_casterDynamic[i] = 1;
+      m_dynamicShadowsDirty = true;
+    } else if (m_casterDynamic[i] &&
+               m_frame - m_casterMoved[i] >= STATIC_CASTER_FRAMES) {
+      m_casterDynamic[i] = 0;
+      m_staticShadowsDirty = true;
+    }
+  }
+}
+
+void DirectionalLightingShadowScheme::fitCascades(
+    const glm::mat4& lightView, const glm::mat4& view, float fov, float aspect,
+    float near, float far, LightUniforms& light) {
+  // the scene box of this frame, moving casters included
+  glm::vec3 lo(std::numeric_limits<float>::max()), hi(-lo);
+  for (size_t i = 0; i < m_worldMin.size(); ++i) {
+    if (m_worldMin[i].x > m_worldMax[i].x) continue;  // no vertices
+    lo = glm::min(lo, m_worldMin[i]);
+    hi = glm::max(hi, m_worldMax[i]);
+  }
+  if (lo.x > hi.x) lo = hi = glm::vec3(0.0f);
+  // depth range of the scene box along the light and the view
+  float zmin = std::numeric_limits<float>::max(), zmax = -zmin;
+  float dmin = zmin, dmax = -zmin;
+  for (int c = 0; c < 8; ++c) {
+    glm::vec4 p(c & 1 ? hi.x : lo.x, c & 2 ? hi.y : lo.y, c & 4 ? hi.z : lo.z,
+                1.0f);
+    float z = (lightView * p).z;
+    zmin = std::min(zmin, z);
+    zmax = std::max(zmax, z);
+    float d = -(view * p).z;
+    dmin = std::min(dmin, d);
+    dmax = std::max(dmax, d);
+  }
+  // Small margin so that casters on the box faces are not clipped. The
+  // range is rounded out to 1/16 of a power of two above its length, so
+  // that casters moving inside the box keep the cascade matrices, and with
+  // them the cached static shadow maps.
+  float margin = 0.01f * (zmax - zmin) + 1e-4f;
+  float z_step = std::exp2(std::ceil(std::log2(zmax - zmin + 2.0f * margin))) /
+                 16.0f;
+  m_lightNearPlane = std::floor((-zmax - margin) / z_step) * z_step;
+  m_lightFarPlane = std::ceil((-zmin + margin) / z_step) * z_step;
+  // split only the part of the view that can contain geometry
+  near = std::max(near, dmin);
+  far = std::max(std::min(far, dmax), near * 1.001f);
+
+  const glm::mat4 inv_view = glm::inverse(view);
+  const float ty = std::tan(0.5f * fov), tx = ty * aspect;
+  const float res = (float)m_shadowResolution;
+  float d0 = near;
+  for (unsigned int i = 0; i < m_cascadeCount; ++i) {
+    // practical split scheme: blend of logarithmic and uniform splits
+    float f = float(i + 1) / m_cascadeCount;
+    float d1 = m_cascadeSplitLambda * near * std::pow(far / near, f) +
+               (1.0f - m_cascadeSplitLambda) * (near + (far - near) * f);
+    // bounding sphere of the slice, its size does not depend on the view
+    // direction so the shadow map texels do not swim while rotating
+    glm::vec3 corners[8];
+    glm::vec3 center(0.0f);
+    for (int c = 0; c < 8; ++c) {
+      float d = c & 4 ? d1 : d0;
+      glm::vec4 p(c & 1 ? d * tx : -d * tx, c & 2 ? d * ty : -d * ty, -d, 1);
+      corners[c] = glm::vec3(inv_view * p);
+      center += corners[c] / 8.0f;
+    }
+    float r = 0.0f;
+    for (const glm::vec3& p : corners) r = std::max(r, glm::length(p - center));
+    // Quantize the light frustum so that small view changes keep it, and
+    // with it the cached shadow map: the half size grows in steps of 1/8
+    // octave, the center moves in steps of at most 1/8 of the half size.
+    // A step is a whole number of texels, so the shadow edges do not
+    // shimmer while translating. r / (1 - 1/8) still covers the sphere.
+    r = std::exp2(std::ceil(8.0f * std::log2(r * 8.0f / 7.0f)) / 8.0f);
+    glm::vec3 c = glm::vec3(lightView * glm::vec4(center, 1.0f));
+    float step = 2.0f * r / res * std::max(1u, m_shadowResolution / 16);
+    c.x = std::floor(c.x / step) * step;
+    c.y = std::floor(c.y / step) * step;
+    m_cascadeRects[i] = glm::vec4(c.x - r, c.x + r, c.y - r, c.y + r);
+    // Shadows fall away from the light (toward -z), so only casters nearer
+    // the light than the farthest receiver of the slice can reach it. The
+    // bound is quantized like the center, so that the cached shadow map and
+    // the culling it was drawn with survive small view changes.
+    float z = std::numeric_limits<float>::max();
+    for (const glm::vec3& p : corners)
+      z = std::min(z, (lightView * glm::vec4(p, 1.0f)).z);
+    z = std::max(z, -m_lightFarPlane);
+    m_cascadeReceiverZ[i] = std::floor(z / step) * step;
+    glm::mat4 lightProjection =
+        glm::ortho(c.x - r, c.x + r, c.y - r, c.y + r, m_lightNearPlane,
+                   m_lightFarPlane);
+    light.cascadeMatrices[i] = lightProjection * lightView;
+    light.cascadeSplits[i] = d1;
+    d0 = d1;
+  }
+  light.cascades = glm::ivec4(m_cascadeCount, 0, 0, 0);
 }
 
 void DirectionalLightingShadowScheme::Render() {
   glEnable(GL_DEPTH_TEST);
+  GLState& gl_state = GLState::Instance();
   // save viewport dimension
   GLint viewport_old[4];
-  glGetIntegerv(GL_VIEWPORT, viewport_old);
+  for (int i = 0; i < 4; ++i) viewport_old[i] = gl_state.Viewport()[i];
   GLint& SCR_WIDTH = viewport_old[2];
   GLint& SCR_HEIGHT = viewport_old[3];
 
-  // std::cout << "Old Viewport: ";
-  // for (int i = 0; i < 4; ++i) std::cout << " " << viewport_old[i];
-  // std::cout << std::endl;
+  // 0. fit the cascades and sort the draw calls of all passes
+  // --------------------------------------------------------------
+  Camera& cam = m_navigation->camera();
+  float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+  glm::mat4 projection = glm::perspective(glm::radians(cam.Zoom), aspect,
+                                          cam.near_plane, cam.far_plane);
+  const glm::mat4 view = cam.GetViewMatrix();
+  const glm::mat4 lightView = glm::lookAt(
+      m_lightPos, m_lightPos + m_lightDirection, glm::vec3(0.0, 1.0, 0.0));
+  // the cascades are fitted to the current world bounds
+  UpdateWorldBounds();
+  updateShadowCasters();
+  LightUniforms light;
+  fitCascades(lightView, view, glm::radians(cam.Zoom), aspect, cam.near_plane,
+              cam.far_plane, light);
+  light.lightPos = glm::vec4(m_lightPos, 1.0f);
+  // a cascade is re-rendered when its light frustum or its casters changed,
+  // the static casters only when they changed
+  bool draw_static[MAX_CASCADES], draw_layer[MAX_CASCADES];
+  for (unsigned int i = 0; i < m_cascadeCount; ++i) {
+    CascadeCache& cache = m_cascadeCache[i];
+    draw_static[i] = !cache.valid || cache.matrix != light.cascadeMatrices[i] ||
+                     cache.receiver_z != m_cascadeReceiverZ[i] ||
+                     m_staticShadowsDirty;
+    draw_layer[i] = draw_static[i] || m_dynamicShadowsDirty;
+    cache.matrix = light.cascadeMatrices[i];
+    cache.receiver_z = m_cascadeReceiverZ[i];
+    cache.valid = true;
+  }
+  m_staticShadowsDirty = m_dynamicShadowsDirty = false;
+  m_renderQueue.Clear();
+  // A mesh casts into a cascade if its light-space bounds overlap the
+  // cascade's light volume extended toward the light: the xy rectangle,
+  // from the farthest receiver of the view slice up to the light. Static
+  // casters go to pass SHADOW + i, moving ones to SHADOW + MAX_CASCADES + i.
+  const std::vector<ObjectModel>& meshes = m_model->meshes;
+  m_casterVisible.resize(meshes.size());
+  m_casterLightMin.resize(meshes.size());
+  m_casterLightMax.resize(meshes.size());
+  for (unsigned int j = 0; j < meshes.size(); ++j) {
+    glm::vec3 lo(std::numeric_limits<float>::max()), hi(-lo);
+    const glm::vec3 &b0 = m_worldMin[j], &b1 = m_worldMax[j];
+    for (int c = 0; c < 8 && b0.x <= b1.x; ++c) {
+      glm::vec3 p(lightView * glm::vec4(c & 1 ? b1.x : b0.x,
+                                        c & 2 ? b1.y : b0.y,
+                                        c & 4 ? b1.z : b0.z, 1.0f));
+      lo = glm::min(lo, p);
+      hi = glm::max(hi, p);
+    }
+    m_casterLightMin[j] = lo;
+    m_casterLightMax[j] = hi;
+  }
+  m_shadowStats = ShadowStats();
+  for (unsigned int i = 0; i < m_cascadeCount; ++i) {
+    if (!draw_layer[i]) continue;
+    const glm::vec4& r = m_cascadeRects[i];
+    for (int dynamic = 0; dynamic < 2; ++dynamic) {
+      if (!dynamic && !draw_static[i]) continue;
+      for (unsigned int j = 0; j < meshes.size(); ++j) {
+        if (m_casterDynamic[j] != dynamic) {
+          m_casterVisible[j] = 0;
+          continue;
+        }
+        const glm::vec3 &lo = m_casterLightMin[j], &hi = m_casterLightMax[j];
+        m_casterVisible[j] = hi.x >= r.x && lo.x <= r.y && hi.y >= r.z &&
+                             lo.y <= r.w && hi.z >= m_cascadeReceiverZ[i];
+        if (m_casterVisible[j])
+          ++m_shadowStats.drawn;
+        else
+          ++m_shadowStats.culled;
+      }
+      SubmitModel(RenderQueue::ShadowPass(dynamic * MAX_CASCADES + i),
+                  simpleDepthShader, lightView, m_lightNearPlane,
+                  m_lightFarPlane, &m_casterVisible,
+                  ObjectModel::HAS_ALPHA_TEST);
+    }
+  }
+  if (m_depthPrepass)
+    SubmitModel(RenderQueue::DEPTH, depthPrepassShader, view, cam.near_plane,
+                cam.far_plane, nullptr, ObjectModel::HAS_ALPHA_TEST);
+  SubmitModel(RenderQueue::OPAQUE, shader, view, cam.near_plane,
+              cam.far_plane);
+  m_renderQueue.Sort();
+  // upload the uniform blocks once, for all programs
+  FrameUniforms frame;
+  frame.projection = projection;
+  frame.view = view;
+  frame.viewPos = glm::vec4(cam.Position(), 1.0f);
+  m_frameBlock.Bind();
+  m_frameBlock.Update(frame);
+  m_lightBlock.Bind();
+  m_lightBlock.Update(light);
 
-  // 1. render depth of scene to texture (from light's perspective)
+  // 1. render depth of scene to each changed cascade (from light's
+  // perspective)
   // --------------------------------------------------------------
-  glm::mat4 lightProjection, lightView;
-  glm::mat4 lightSpaceMatrix;
-  lightProjection =
-      glm::ortho(-m_lightRadius, m_lightRadius, -m_lightRadius, m_lightRadius,
-                 m_lightNearPlane, m_lightFarPlane);
-  lightView = glm::lookAt(m_lightPos, m_lightPos + m_lightDirection,
-                          glm::vec3(0.0, 1.0, 0.0));
-  lightSpaceMatrix = lightProjection * lightView;
-  // render scene from light's point of view
-  simpleDepthShader.use();
-  simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-  simpleDepthShader.setMat4("model", glm::mat4(1.0f));
-
-  glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-  glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-  glClear(GL_DEPTH_BUFFER_BIT);
-  m_model->Draw(simpleDepthShader);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  UpdateObjectBlock();
+  m_shadowTimer.Begin();
+  const GLint res = m_shadowResolution;
+  gl_state.Viewport(0, 0, res, res);
+  for (unsigned int i = 0; i < m_cascadeCount; ++i) {
+    if (!draw_layer[i]) continue;
+    simpleDepthShader.set(m_depthCascade, (int)i);
+    gl_state.BindFramebuffer(staticDepthMapFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              staticDepthMap, 0, i);
+    if (draw_static[i]) {
+      glClear(GL_DEPTH_BUFFER_BIT);
+      m_renderQueue.Draw(RenderQueue::ShadowPass(i), &m_objectBlock);
+    }
+    // start from the cached static casters, then add the moving ones
+    gl_state.BindFramebuffer(depthMapFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMap, 0,
+                              i);
+    gl_state.BindReadFramebuffer(staticDepthMapFBO);
+    glBlitFramebuffer(0, 0, res, res, 0, 0, res, res, GL_DEPTH_BUFFER_BIT,
+                      GL_NEAREST);
+    gl_state.BindReadFramebuffer(depthMapFBO);
+    m_renderQueue.Draw(RenderQueue::ShadowPass(MAX_CASCADES + i),
+                       &m_objectBlock);
+  }
+  if (m_shadowFilter == EVSM)
+    for (unsigned int i = 0; i < m_cascadeCount; ++i)
+      if (draw_layer[i]) filterEvsm(i);
+  gl_state.BindFramebuffer(0);
+  m_shadowTimer.End();
 
   // reset viewport
-  glViewport(viewport_old[0], viewport_old[1], viewport_old[2],
-             viewport_old[3]);
+  gl_state.Viewport(viewport_old[0], viewport_old[1], viewport_old[2],
+                    viewport_old[3]);
 
   // 2. render scene as normal using the generated depth/shadow map
   // --------------------------------------------------------------
   glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  Camera& cam = m_navigation->camera();
-  glm::mat4 projection = glm::perspective(glm::radians(cam.Zoom),
-                                          (float)SCR_WIDTH / (float)SCR_HEIGHT,
-                                          cam.near_plane, cam.far_plane);
-  const glm::mat4 view = cam.GetViewMatrix();
-  shader.use();
-  shader.setMat4("projection", projection);
-  shader.setMat4("view", view);
-  shader.setMat4("model", glm::mat4(1.0f));
-  // set light uniforms
-  shader.setVec3("viewPos", cam.Position());
-  shader.setVec3("lightPos", m_lightPos);
-  shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-  glActiveTexture(GL_TEXTURE0 + m_colorTexUnitNum);
-  glBindTexture(GL_TEXTURE_2D, depthMap);
-  shader.setInt("shadowMap", m_colorTexUnitNum);
-  m_model->Draw(shader);
+  if (m_depthPrepass) {
+    m_prepassTimer.Begin();
+    m_renderQueue.Draw(RenderQueue::DEPTH, &m_objectBlock);
+    m_prepassTimer.End();
+    // only the nearest fragment of each pixel passes, and the depth is final
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+  }
+  gl_state.BindTexture(m_colorTexUnitNum, GL_TEXTURE_2D_ARRAY,
+                       m_shadowFilter == EVSM ? evsmMoments : depthMap);
+  m_lightingTimer.Begin();
+  m_renderQueue.Draw(RenderQueue::OPAQUE, &m_objectBlock);
+  m_lightingTimer.End();
+  if (m_depthPrepass) {
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+  }
 
   // 3. render trackball
   glm::mat4 M(1.0f);
@@ -144,8 +573,6 @@ void DirectionalLightingShadowScheme::Render() {
   s *= m_navigation->GetTrackballDistance();
   M = glm::scale(M, glm::vec3(s));
   uniColorShader.use();
-  uniColorShader.setMat4("projection", projection);
-  uniColorShader.setMat4("view", view);
   m_trackball.Draw(uniColorShader, M);
 
   // 4. render light source
@@ -162,30 +589,28 @@ void DirectionalLightingShadowScheme::Render() {
 
 void RenderingScheme::SetModel(const SceneModel* model) {
   m_model = model;
-  // compute bounding box
-  const glm::vec3& p0 = m_model->meshes[0].positions[0];
-  bbox[0] = p0.x;
-  bbox[1] = p0.x;
-  bbox[2] = p0.y;
-  bbox[3] = p0.y;
-  bbox[4] = p0.z;
-  bbox[5] = p0.z;
-  for (const ObjectModel& mesh : m_model->meshes) {
-    for (const glm::vec3& p : mesh.positions) {
-      if (p.x < bbox[0])
-        bbox[0] = p.x;
-      else if (p.x > bbox[1])
-        bbox[1] = p.x;
-      if (p.y < bbox[2])
-        bbox[2] = p.y;
-      else if (p.y > bbox[3])
-        bbox[3] = p.y;
-      if (p.z < bbox[4])
-        bbox[4] = p.z;
-      else if (p.z > bbox[5])
-        bbox[5] = p.z;
-    }
+  ++m_modelSerial;
+  // compute bounding box by merging the cached mesh bounds
+  const std::vector<ObjectModel>& meshes = m_model->meshes;
+  ObjectModel::UpdateBounds(meshes);
+  m_worldMin.resize(meshes.size());
+  m_worldMax.resize(meshes.size());
+  m_meshCenters.resize(meshes.size());
+  m_worldBoundsVersions.assign(meshes.size(), ~uint64_t(0));
+  UpdateWorldBounds();
+  glm::vec3 lo(std::numeric_limits<float>::max());
+  glm::vec3 hi(-std::numeric_limits<float>::max());
+  for (unsigned int i = 0; i < meshes.size(); ++i) {
+    lo = glm::min(lo, m_worldMin[i]);
+    hi = glm::max(hi, m_worldMax[i]);
   }
+  if (lo.x > hi.x) lo = hi = glm::vec3(0.0f);
+  bbox[0] = lo.x;
+  bbox[1] = hi.x;
+  bbox[2] = lo.y;
+  bbox[3] = hi.y;
+  bbox[4] = lo.z;
+  bbox[5] = hi.z;
 
   std::cout << "BBox: ";
   for (int i = 0; i < 6; ++i) std::cout << "  " << bbox[i];
@@ -199,14 +624,109 @@ void RenderingScheme::SetModel(const SceneModel* model) {
 
   // compute number of texture units used by model.Draw
   unsigned int tex_num = 1;
+  const MaterialLibrary& materials = MaterialLibrary::Instance();
   for (const ObjectModel& mesh : m_model->meshes)
-    if (tex_num < mesh.textures.size()) tex_num = mesh.textures.size();
+    if (tex_num < materials[mesh.material].TextureCount())
+      tex_num = materials[mesh.material].TextureCount();
   m_colorTexUnitNum = tex_num;
 
+  // per-object uniforms, uploaded by the first UpdateObjectBlock()
+  if (m_objectBlock.Capacity() > 0) m_objectBlock.Release();
+  m_objectBlock.Create(m_model->meshes.size());
+  m_objectVersions.assign(m_model->meshes.size(), ~0u);
+
+  // variants may depend on the model, e.g. on its sampler units
+  for (ShaderVariants* v : m_shaderVariants) v->Release();
+
   std::cout << "color texture units number = " << m_colorTexUnitNum
             << std::endl;
 }
 
+void RenderingScheme::SubmitModel(RenderQueue::Pass pass, Shader& shader,
+                                  const glm::mat4& view, float near, float far,
+                                  const std::vector<unsigned char>* visible) {
+  UpdateWorldBounds();
+  for (unsigned int i = 0; i < m_model->meshes.size(); ++i)
+    if (!visible || (*visible)[i])
+      m_renderQueue.Submit(pass, shader, m_model->meshes[i], i,
+                           MeshDepth(i, view, near, far));
+}
+
+void RenderingScheme::SubmitModel(RenderQueue::Pass pass,
+                                  ShaderVariants& shaders,
+                                  const glm::mat4& view, float near, float far,
+                                  const std::vector<unsigned char>* visible,
+                                  unsigned int feature_mask) {
+  UpdateWorldBounds();
+  for (unsigned int i = 0; i < m_model->meshes.size(); ++i) {
+    if (visible && !(*visible)[i]) continue;
+    const ObjectModel& mesh = m_model->meshes[i];
+    m_renderQueue.Submit(pass, shaders.Get(mesh.Features() & feature_mask),
+                         mesh, i, MeshDepth(i, view, near, far));
+  }
+}
+
+float RenderingScheme::MeshDepth(unsigned int i, const glm::mat4& view,
+                                 float near, float far) const {
+  glm::vec4 c = view * glm::vec4(m_meshCenters[i], 1.0f);
+  return (-c.z - near) / (far - near);
+}
+
+ObjectUniforms RenderingScheme::ObjectData(unsigned int i) const {
+  const ObjectModel& mesh = m_model->meshes[i];
+  ObjectUniforms object;
+  object.model = mesh.GetTransform();
+  object.normalMatrix = glm::mat4(mesh.GetNormalMatrix());
+  object.material = glm::ivec4(mesh.material, i, 0, 0);
+  const Material& m = MaterialLibrary::Instance()[mesh.material];
+  const glm::vec3& ks = m.specular_color;
+  float specular = std::max(ks.x, std::max(ks.y, ks.z));
+  float shininess = m.shininess > 0.0f ? m.shininess : 32.0f;
+  object.surface = glm::vec4(specular, shininess, 0.0f, 0.0f);
+  return object;
+}
+
+void RenderingScheme::UpdateObjectBlock() {
+  for (unsigned int i = 0; i < m_model->meshes.size(); ++i) {
+    const ObjectModel& mesh = m_model->meshes[i];
+    if (m_objectVersions[i] == mesh.TransformVersion()) continue;
+    m_objectVersions[i] = mesh.TransformVersion();
+    m_objectBlock.Update(i, ObjectData(i));
+  }
+}
+
+void RenderingScheme::UpdateWorldBounds() {
+  for (unsigned int i = 0; i < m_model->meshes.size(); ++i) {
+    const ObjectModel& mesh = m_model->meshes[i];
+    uint64_t version =
+        (uint64_t)mesh.TransformVersion() << 32 | mesh.InstanceVersion();
+    if (m_worldBoundsVersions[i] == version) continue;
+    m_worldBoundsVersions[i] = version;
+    // an empty box (min > max) for meshes without vertices
+    glm::vec3 lo(std::numeric_limits<float>::max()), hi(-lo);
+    if (!mesh.positions.empty()) {
+      if (mesh.InstanceCount() == 0)
+        ExtendBox(lo, hi, mesh, mesh.GetTransform());
+      for (const glm::mat4& Ti : mesh.Instances())
+        ExtendBox(lo, hi, mesh, mesh.GetTransform() * Ti);
+    }
+    m_worldMin[i] = lo;
+    m_worldMax[i] = hi;
+    m_meshCenters[i] = 0.5f * (lo + hi);
+  }
+}
+
+void RenderingScheme::ReloadShaders(const std::string& file_name) {
+  for (Shader* s : m_shaders)
+    if (s->UsesFile(file_name)) s->Reload();
+  for (ShaderVariants* v : m_shaderVariants) v->ReloadShaders(file_name);
+}
+
+void RenderingScheme::PollShaders() {
+  for (Shader* s : m_shaders) s->PollReload();
+  for (ShaderVariants* v : m_shaderVariants) v->PollShaders();
+}
+
 void RenderingScheme::InitNavigationFromBBox() {
   glm::vec3 p = m_bboxCenter;
   p.z += 1.5f * (bbox[5] - bbox[4]);
@@ -226,7 +746,9 @@ void RenderingScheme::InitNavigationFromBBox() {
 
 SimpleRenderingScheme::SimpleRenderingScheme()
     : shader((res_dir() + "/simple_rendering.vs").c_str(),
-             (res_dir() + "/simple_rendering.fs").c_str()) {}
+             (res_dir() + "/simple_rendering.fs").c_str()) {
+  m_shaders = {&shader};
+}
 
 SimpleRenderingScheme::SimpleRenderingScheme(const SceneModel* model,
                                              Navigation* nav)
@@ -241,17 +763,22 @@ void SimpleRenderingScheme::Render() {
   glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   // viewport dimension
-  GLint viewport[4];
-  glGetIntegerv(GL_VIEWPORT, viewport);
-  GLint& SCR_WIDTH = viewport[2];
-  GLint& SCR_HEIGHT = viewport[3];
+  const GLint* viewport = GLState::Instance().Viewport();
+  const GLint& SCR_WIDTH = viewport[2];
+  const GLint& SCR_HEIGHT = viewport[3];
   glm::mat4 projection =
       glm::perspective(glm::radians(m_navigation->camera().Zoom),
                        (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
   glm::mat4 view = m_navigation->camera().GetViewMatrix();
-  shader.use();
-  shader.setMat4("projection", projection);
-  shader.setMat4("view", view);
-  shader.setMat4("model", glm::mat4(1.0f));
-  m_model->Draw(shader);
+  m_renderQueue.Clear();
+  SubmitModel(RenderQueue::OPAQUE, shader, view, 0.1f, 100.0f);
+  m_renderQueue.Sort();
+  FrameUniforms frame;
+  frame.projection = projection;
+  frame.view = view;
+  frame.viewPos = glm::vec4(m_navigation->camera().Position(), 1.0f);
+  m_frameBlock.Bind();
+  m_frameBlock.Update(frame);
+  UpdateObjectBlock();
+  m_renderQueue.Draw(RenderQueue::OPAQUE, &m_objectBlock);
 }
@@ -1,52 +1,239 @@
 #ifndef _3D_VIEWER_RENDERING_SCHEME_H
 #define _3D_VIEWER_RENDERING_SCHEME_H
 
+#include <utility>
+#include <vector>
+
+#include "gpu_timer.h"
 #include "model.h"
 #include "navigate.h"
+#include "render_queue.h"
 #include "shader.h"
+#include "shader_variants.h"
+#include "uniform_buffer.h"
 
 class RenderingScheme {
  public:
+  RenderingScheme();
+  virtual ~RenderingScheme();
   virtual void Render() = 0;
   void SetModel(const SceneModel*);
   void SetNavigation(Navigation* nav) { m_navigation = nav; }
   void InitNavigationFromBBox();
+  /** start recompiling the programs that use the source file file_name
+   */
+  void ReloadShaders(const std::string& file_name);
+  /** swap in reloaded programs that finished compiling, once per frame
+   */
+  void PollShaders();
+  /** draw the opaque pass front-to-back, the default, or grouped by state
+   * with false, see RenderQueue
+   */
+  void SetFrontToBack(bool on) { m_renderQueue.SetFrontToBack(on); }
+  glm::vec3 BBoxMin() const { return glm::vec3(bbox[0], bbox[2], bbox[4]); }
+  glm::vec3 BBoxMax() const { return glm::vec3(bbox[1], bbox[3], bbox[5]); }
+
+  /** GPU timers of the passes of the scheme, with their names, in drawing
+   * order
+   */
+  typedef std::vector<std::pair<const char*, GpuTimer*>> TimerList;
+  virtual TimerList Timers() { return TimerList(); }
+  void ResetTimers() {
+    for (auto& timer : Timers()) timer.second->Reset();
+  }
 
  protected:
   const SceneModel* m_model;
+  unsigned int m_modelSerial;  // incremented by SetModel()
   Navigation* m_navigation;
 
   float bbox[6];  // { xmin, xmax, ymin, ymax, zmin, zmax }
   glm::vec3 m_bboxCenter;
   unsigned int m_colorTexUnitNum;
+  RenderQueue m_renderQueue;
+  // programs of the scheme, for reloading
+  std::vector<Shader*> m_shaders;
+  std::vector<ShaderVariants*> m_shaderVariants;
+  // uniform blocks shared by all programs of the scheme
+  UniformBuffer m_frameBlock;  // FrameUniforms
+  UniformBuffer m_lightBlock;  // LightUniforms
+  // per-mesh ObjectUniforms, one slot per mesh of the model
+  ObjectUniformBuffer m_objectBlock;
+  std::vector<unsigned int> m_objectVersions;  // uploaded TransformVersion
+  // world-space bounds of each mesh with all its instances
+  std::vector<glm::vec3> m_worldMin, m_worldMax;
+  // world-space center of those bounds, the depth of the mesh's draw calls
+  // in the render queue
+  std::vector<glm::vec3> m_meshCenters;
+  std::vector<uint64_t> m_worldBoundsVersions;  // transform, instance version
+
+  /** submit every mesh of the model to the render queue, keyed by its depth
+   * in the given view normalized to [near, far]. If visible is given, only
+   * meshes i with visible[i] set are submitted.
+   */
+  void SubmitModel(RenderQueue::Pass pass, Shader& shader,
+                   const glm::mat4& view, float near, float far,
+                   const std::vector<unsigned char>* visible = nullptr);
+  // each mesh drawn with the variant matching its features in feature_mask
+  void SubmitModel(RenderQueue::Pass pass, ShaderVariants& shaders,
+                   const glm::mat4& view, float near, float far,
+                   const std::vector<unsigned char>* visible = nullptr,
+                   unsigned int feature_mask = ~0u);
+  // normalized depth of mesh i's center in the given view
+  float MeshDepth(unsigned int i, const glm::mat4& view, float near,
+                  float far) const;
+  // per-object uniforms of mesh i
+  ObjectUniforms ObjectData(unsigned int i) const;
+  /** upload the per-object data of meshes whose transform changed
+   */
+  void UpdateObjectBlock();
+  /** recompute the world bounds and centers of meshes whose transform or
+   * instances changed; also done by SubmitModel()
+   */
+  void UpdateWorldBounds();
 };
 
 class DirectionalLightingShadowScheme : public RenderingScheme {
  public:
+  /** Filtering of the shadow map edges, SHADOW_FILTER in shadow_rendering.fs.
+   * PCF_KERNEL k sets the footprint of the PCF filters.
+   */
+  enum ShadowFilter {
+    PCF_GRID,      // (2k+1)^2 depth comparisons
+    PCF_HARDWARE,  // (2k)^2 bilinear comparisons by a shadow sampler
+    PCF_POISSON,   // 16 taps of a rotated Poisson disk, 4 on plain regions
+    EVSM,          // exponential variance shadow maps, blurred at 1/2 size
+    SHADOW_FILTER_NUM
+  };
+  static const char* ShadowFilterName(ShadowFilter filter);
+
   DirectionalLightingShadowScheme();
   DirectionalLightingShadowScheme(const SceneModel*, Navigation*);
   ~DirectionalLightingShadowScheme();
-  void SetLight(const glm::vec3& p, const glm::vec3& dir, float near, float far,
-                float r) {
+  // the shadow frustums are fitted to the view every frame
+  void SetLight(const glm::vec3& p, const glm::vec3& dir) {
     m_lightPos = p;
     m_lightDirection = dir;
-    m_lightNearPlane = near;
-    m_lightFarPlane = far;
-    m_lightRadius = r;
+    InvalidateShadows();
   }
+  /** Split the view into count <= MAX_CASCADES depth ranges, each with its
+   * own resolution x resolution shadow map. lambda blends uniform (0) and
+   * logarithmic (1) split distances.
+   */
+  void SetShadowCascades(unsigned int count, unsigned int resolution,
+                         float lambda = 0.75f);
+  /** re-render all shadow maps in the next frame, for changes the scheme
+   * cannot see, e.g. edited vertices
+   */
+  void InvalidateShadows();
   virtual void Render() override;
 
+  /** mesh-cascade pairs submitted to and culled from the shadow passes in
+   * the last frame; cascades reused from the cache count neither
+   */
+  struct ShadowStats {
+    unsigned int drawn;
+    unsigned int culled;
+  };
+  const ShadowStats& GetShadowStats() const { return m_shadowStats; }
+
+  void SetShadowFilter(ShadowFilter filter);
+  ShadowFilter GetShadowFilter() const { return m_shadowFilter; }
+  /** Lay down the depth of the opaque meshes first, from positions only, and
+   * shade with GL_EQUAL depth testing, so each pixel is lit once. Pays off
+   * when overdraw of the lit pass costs more than drawing the scene twice.
+   */
+  void SetDepthPrepass(bool on) { m_depthPrepass = on; }
+  bool GetDepthPrepass() const { return m_depthPrepass; }
+  // GPU time of the depth prepass, of the shadow maps (with their EVSM
+  // filtering) and of the lit pass reading them
+  const GpuTimer& PrepassTimer() const { return m_prepassTimer; }
+  const GpuTimer& ShadowMapTimer() const { return m_shadowTimer; }
+  const GpuTimer& LightingTimer() const { return m_lightingTimer; }
+  virtual TimerList Timers() override {
+    return {{"depth prepass", &m_prepassTimer},
+            {"shadow maps", &m_shadowTimer},
+            {"lit pass", &m_lightingTimer}};
+  }
+
  private:
-  Shader shader;
-  Shader simpleDepthShader;
+  ShaderVariants shader;
+  ShaderVariants simpleDepthShader;  // only alpha testing needs a variant
+  ShaderVariants depthPrepassShader;  // same
   Shader uniColorShader;
+  Shader evsmConvertShader, evsmBlurShader;
   unsigned int depthMapFBO;
-  unsigned int depthMap;
-  const unsigned int SHADOW_WIDTH, SHADOW_HEIGHT;
+  unsigned int depthMap;  // depth texture array, one layer per cascade
+  // The static casters of each cascade are cached in staticDepthMap and only
+  // re-rendered when they or the cascade change. depthMap holds a copy of
+  // them with the moving casters drawn over it.
+  unsigned int staticDepthMapFBO;
+  unsigned int staticDepthMap;
+  // EVSM moments of each cascade at 1/m_evsmDownsample of the depth
+  // resolution, and a layer for the blur in between; 0 unless filtering
+  // with EVSM
+  unsigned int evsmFBO;
+  unsigned int evsmMoments, evsmTemp;
+  unsigned int m_evsmDownsample;
+  unsigned int m_emptyVAO;  // for full-screen triangles
+  UniformHandle<int> m_evsmLayer, m_evsmDownsampleUniform, m_blurLayer;
+  UniformHandle<glm::vec2> m_blurDirection;
+  VariantUniform<int> m_depthCascade;
+  ShadowFilter m_shadowFilter;
+  bool m_depthPrepass;
+  GpuTimer m_prepassTimer, m_shadowTimer, m_lightingTimer;
+  unsigned int m_cascadeCount;
+  unsigned int m_shadowResolution;
+  float m_cascadeSplitLambda;
   glm::vec3 m_lightPos;
   glm::vec3 m_lightDirection;
-  float m_lightNearPlane, m_lightFarPlane, m_lightRadius;
+  // fitted by fitCascades(): light-space xy rectangle (x0, x1, y0, y1) of
+  // each cascade, the light-space z of its farthest receiver from the light,
+  // and the light-space depth range of the scene
+  glm::vec4 m_cascadeRects[MAX_CASCADES];
+  float m_cascadeReceiverZ[MAX_CASCADES];
+  float m_lightNearPlane, m_lightFarPlane;
+  // shadow map cache
+  struct CascadeCache {
+    // light space matrix and receiver z the layers were rendered and
+    // culled with
+    glm::mat4 matrix;
+    float receiver_z;
+    bool valid;
+  };
+  CascadeCache m_cascadeCache[MAX_CASCADES];
+  unsigned int m_shadowModelSerial;  // m_modelSerial the cache belongs to
+  unsigned long m_frame;
+  // per mesh: world bounds version last seen, frame it last changed, and
+  // whether it is drawn as a moving caster
+  std::vector<uint64_t> m_casterVersions;
+  std::vector<unsigned long> m_casterMoved;
+  std::vector<unsigned char> m_casterDynamic;
+  bool m_staticShadowsDirty;   // the static casters changed
+  bool m_dynamicShadowsDirty;  // a moving caster changed this frame
+  // per mesh scratch: light-space bounds, and the cascade culling result
+  std::vector<glm::vec3> m_casterLightMin, m_casterLightMax;
+  std::vector<unsigned char> m_casterVisible;
+  ShadowStats m_shadowStats;
   TrackballModel m_trackball;
+  int m_pcfKernel;  // PCF over (2k+1)^2 shadow map texels
+
+  void createShadowMap();
+  void releaseShadowMap();
+  // sampler state, EVSM textures and shader defines of m_shadowFilter
+  void applyShadowFilter();
+  // compute the blurred EVSM moments of a shadow map layer
+  void filterEvsm(unsigned int layer);
+  /** classify the casters into static and moving ones, and record which
+   * kinds changed since the last frame
+   */
+  void updateShadowCasters();
+  /** split the view frustum clipped to the scene box, and fit a texel-snapped
+   * light frustum around each part
+   */
+  void fitCascades(const glm::mat4& lightView, const glm::mat4& view,
+                   float fov, float aspect, float near, float far,
+                   LightUniforms& light);
 };
 
 class SimpleRenderingScheme : public RenderingScheme {
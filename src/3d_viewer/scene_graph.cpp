@@ -0,0 +1,81 @@
+#include "scene_graph.h"
+
+#include <algorithm>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+namespace {
+// out = a * b for column-major 4x4 matrices; out may not alias a or b
+void MultiplyMat4(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out) {
+#ifdef __SSE__
+  const float *pa = &a[0][0];
+  const float *pb = &b[0][0];
+  float *po = &out[0][0];
+  __m128 a0 = _mm_loadu_ps(pa);
+  __m128 a1 = _mm_loadu_ps(pa + 4);
+  __m128 a2 = _mm_loadu_ps(pa + 8);
+  __m128 a3 = _mm_loadu_ps(pa + 12);
+  // column j of out is a combination of the columns of a
+  for (int j = 0; j < 4; ++j) {
+    const float *bj = pb + 4 * j;
+    __m128 c = _mm_mul_ps(a0, _mm_set1_ps(bj[0]));
+    c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(bj[1])));
+    c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(bj[2])));
+    c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(bj[3])));
+    _mm_storeu_ps(po + 4 * j, c);
+  }
+#else
+  out = a * b;
+#endif
+}
+}  // namespace
+
+unsigned int SceneGraph::AddNode(unsigned int parent, const glm::mat4 &local,
+                                 const std::string &name) {
+  m_local.push_back(local);
+  m_world.push_back(local);
+  m_parent.push_back(parent);
+  m_names.push_back(name);
+  m_dirty.push_back(1);
+  m_changed.push_back(0);
+  m_anyDirty = true;
+  return m_local.size() - 1;
+}
+
+void SceneGraph::SetLocal(unsigned int node, const glm::mat4 &local) {
+  m_local[node] = local;
+  m_dirty[node] = 1;
+  m_anyDirty = true;
+}
+
+unsigned int SceneGraph::Find(const std::string &name) const {
+  auto it = std::find(m_names.begin(), m_names.end(), name);
+  return it == m_names.end() ? NONE : it - m_names.begin();
+}
+
+unsigned int SceneGraph::UpdateWorld() {
+  if (!m_anyDirty) {
+    // nothing changed since the last update
+    if (m_anyChanged) std::fill(m_changed.begin(), m_changed.end(), 0);
+    m_anyChanged = false;
+    return 0;
+  }
+  // parents come first, so their flags and matrices are final here
+  unsigned int updated = 0;
+  for (unsigned int i = 0; i < m_local.size(); ++i) {
+    unsigned int p = m_parent[i];
+    bool dirty = m_dirty[i] || (p != NONE && m_changed[p]);
+    m_changed[i] = dirty;
+    if (!dirty) continue;
+    m_dirty[i] = 0;
+    if (p == NONE)
+      m_world[i] = m_local[i];
+    else
+      MultiplyMat4(m_world[p], m_local[i], m_world[i]);
+    ++updated;
+  }
+  m_anyDirty = false;
+  m_anyChanged = updated > 0;
+  return updated;
+}
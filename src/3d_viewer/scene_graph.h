@@ -0,0 +1,49 @@
+#ifndef _3D_VIEWER_SCENE_GRAPH_H
+#define _3D_VIEWER_SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+/** Node hierarchy stored as flat arrays in topological order: a node is
+ * always added after its parent, so world matrices are updated in a single
+ * forward pass without recursion. Changing a local transform only marks the
+ * node dirty; UpdateWorld() recomputes it and its descendants.
+ */
+class SceneGraph {
+ public:
+  static const unsigned int NONE = ~0u;
+
+  /** add a node below parent (NONE for a root), returns its index
+   */
+  unsigned int AddNode(unsigned int parent, const glm::mat4 &local,
+                       const std::string &name = "");
+  void SetLocal(unsigned int node, const glm::mat4 &local);
+  const glm::mat4 &Local(unsigned int node) const { return m_local[node]; }
+  // valid after UpdateWorld()
+  const glm::mat4 &World(unsigned int node) const { return m_world[node]; }
+  unsigned int Parent(unsigned int node) const { return m_parent[node]; }
+  const std::string &Name(unsigned int node) const { return m_names[node]; }
+  // first node with the name, NONE if there is none
+  unsigned int Find(const std::string &name) const;
+  unsigned int Size() const { return m_local.size(); }
+
+  /** recompute the world matrices of dirty nodes and their descendants,
+   * returns the number of nodes updated
+   */
+  unsigned int UpdateWorld();
+  // true if the world matrix of node changed in the last UpdateWorld()
+  bool Changed(unsigned int node) const { return m_changed[node]; }
+
+ private:
+  std::vector<glm::mat4> m_local;
+  std::vector<glm::mat4> m_world;
+  std::vector<unsigned int> m_parent;
+  std::vector<std::string> m_names;
+  std::vector<unsigned char> m_dirty;
+  std::vector<unsigned char> m_changed;
+  bool m_anyDirty = false;
+  bool m_anyChanged = false;
+};
+
+#endif  // _3D_VIEWER_SCENE_GRAPH_H
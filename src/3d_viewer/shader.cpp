@@ -2,16 +2,101 @@
 
 #include "shader.h"
 
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <vector>
+
+#include "config.h"
+#include "gl_ext.h"
+#include "gl_state.h"
+#include "material.h"
+#include "uniform_buffer.h"
+
+namespace {
+// 64-bit FNV-1a, chained through h
+uint64_t Fnv1a(const std::string &s, uint64_t h = 0xcbf29ce484222325ull) {
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+std::string GLString(GLenum name) {
+  const char *s = (const char *)glGetString(name);
+  return s ? s : "";
+}
+
+const char PROGRAM_BINARY_MAGIC[4] = {'G', 'L', 'P', 'B'};
+
+// insert the defines after the #version line, which has to come first
+std::string InjectDefines(const std::string &code,
+                          const std::vector<std::string> &defines) {
+  size_t pos = 0;
+  int version_line = 0;
+  size_t version = code.find("#version");
+  if (version != std::string::npos) {
+    pos = code.find('\n', version);
+    pos = pos == std::string::npos ? code.size() : pos + 1;
+    for (size_t i = 0; i < version; ++i)
+      if (code[i] == '\n') ++version_line;
+    ++version_line;
+  }
+  std::string injected = code.substr(0, pos);
+  if (pos > 0 && injected.back() != '\n') injected += '\n';
+  for (const std::string &define : defines)
+    injected += "#define " + define + "\n";
+  // keep compile error line numbers relative to the file
+  injected += "#line " + std::to_string(version_line + 1) + "\n";
+  injected.append(code, pos, std::string::npos);
+  return injected;
+}
+}  // namespace
 
 Shader::Shader(const char *vertexPath, const char *fragmentPath,
-               const char *geometryPath) {
+               const char *geometryPath,
+               const std::vector<std::string> &defines)
+    : m_vertexPath(vertexPath),
+      m_fragmentPath(fragmentPath),
+      m_geometryPath(geometryPath ? geometryPath : ""),
+      m_defines(defines),
+      m_pendingProgram(0) {
+  static unsigned long shader_count = 0;
+  m_serial = ++shader_count;
   // 1. retrieve the vertex/fragment source code from filePath
   std::string vertexCode;
   std::string fragmentCode;
   std::string geometryCode;
+  readSources(vertexCode, fragmentCode, geometryCode);
+  // 2. try the cached program binary of these sources on this driver
+  ID = glCreateProgram();
+  std::string cache_file = programCacheFile(vertexCode, fragmentCode,
+                                            geometryCode);
+  if (!cache_file.empty() && loadProgramBinary(ID, cache_file)) {
+    BindUniformBlocks(ID);
+    reflectUniforms();
+    return;
+  }
+  // 3. compile shaders and link the program
+  std::vector<unsigned int> stages;
+  compileStages(ID, vertexCode, fragmentCode, geometryCode, stages);
+  if (!cache_file.empty())
+    glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glLinkProgram(ID);
+  if (checkStages(ID, stages) && !cache_file.empty())
+    saveProgramBinary(ID, cache_file);
+  BindUniformBlocks(ID);
+  reflectUniforms();
+}
+
+bool Shader::readSources(std::string &vertexCode, std::string &fragmentCode,
+                         std::string &geometryCode) const {
   std::ifstream vShaderFile;
   std::ifstream fShaderFile;
   std::ifstream gShaderFile;
@@ -21,8 +106,8 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath,
   gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
   try {
     // open files
-    vShaderFile.open(vertexPath);
-    fShaderFile.open(fragmentPath);
+    vShaderFile.open(m_vertexPath);
+    fShaderFile.open(m_fragmentPath);
     std::stringstream vShaderStream, fShaderStream;
     // read file's buffer contents into streams
     vShaderStream << vShaderFile.rdbuf();
@@ -34,8 +119,8 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath,
     vertexCode = vShaderStream.str();
     fragmentCode = fShaderStream.str();
     // if geometry shader path is present, also load a geometry shader
-    if (geometryPath != nullptr) {
-      gShaderFile.open(geometryPath);
+    if (!m_geometryPath.empty()) {
+      gShaderFile.open(m_geometryPath);
       std::stringstream gShaderStream;
       gShaderStream << gShaderFile.rdbuf();
       gShaderFile.close();
@@ -43,94 +128,400 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath,
     }
   } catch (std::ifstream::failure &e) {
     std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    return false;
   }
-  const char *vShaderCode = vertexCode.c_str();
-  const char *fShaderCode = fragmentCode.c_str();
-  // 2. compile shaders
-  unsigned int vertex, fragment;
-  // vertex shader
-  vertex = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex, 1, &vShaderCode, NULL);
-  glCompileShader(vertex);
-  checkCompileErrors(vertex, "VERTEX");
-  // fragment Shader
-  fragment = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment, 1, &fShaderCode, NULL);
-  glCompileShader(fragment);
-  checkCompileErrors(fragment, "FRAGMENT");
-  // if geometry shader is given, compile geometry shader
-  unsigned int geometry;
-  if (geometryPath != nullptr) {
-    const char *gShaderCode = geometryCode.c_str();
-    geometry = glCreateShader(GL_GEOMETRY_SHADER);
-    glShaderSource(geometry, 1, &gShaderCode, NULL);
-    glCompileShader(geometry);
-    checkCompileErrors(geometry, "GEOMETRY");
-  }
-  // shader Program
-  ID = glCreateProgram();
-  glAttachShader(ID, vertex);
-  glAttachShader(ID, fragment);
-  if (geometryPath != nullptr) glAttachShader(ID, geometry);
-  glLinkProgram(ID);
-  checkCompileErrors(ID, "PROGRAM");
+  if (!m_defines.empty()) {
+    vertexCode = InjectDefines(vertexCode, m_defines);
+    fragmentCode = InjectDefines(fragmentCode, m_defines);
+    if (!geometryCode.empty())
+      geometryCode = InjectDefines(geometryCode, m_defines);
+  }
+  return true;
+}
+
+void Shader::compileStages(unsigned int program, const std::string &vertexCode,
+                           const std::string &fragmentCode,
+                           const std::string &geometryCode,
+                           std::vector<unsigned int> &stages) {
+  const GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER,
+                          GL_GEOMETRY_SHADER};
+  const std::string *codes[] = {&vertexCode, &fragmentCode, &geometryCode};
+  stages.clear();
+  for (int i = 0; i < 3; ++i) {
+    // the geometry shader is optional
+    if (i == 2 && geometryCode.empty()) break;
+    const char *code = codes[i]->c_str();
+    unsigned int stage = glCreateShader(types[i]);
+    glShaderSource(stage, 1, &code, NULL);
+    glCompileShader(stage);
+    glAttachShader(program, stage);
+    stages.push_back(stage);
+  }
+}
+
+bool Shader::checkStages(unsigned int program,
+                         std::vector<unsigned int> &stages) {
+  static const char *const types[] = {"VERTEX", "FRAGMENT", "GEOMETRY"};
+  bool success = true;
+  for (unsigned int i = 0; i < stages.size(); ++i)
+    success = checkCompileErrors(stages[i], types[i]) && success;
+  success = checkCompileErrors(program, "PROGRAM") && success;
   // delete the shaders as they're linked into our program now and no longer
   // necessery
-  glDeleteShader(vertex);
-  glDeleteShader(fragment);
-  if (geometryPath != nullptr) glDeleteShader(geometry);
+  for (unsigned int stage : stages) glDeleteShader(stage);
+  stages.clear();
+  return success;
+}
+
+bool Shader::UsesFile(const std::string &file_name) const {
+  for (const std::string *path :
+       {&m_vertexPath, &m_fragmentPath, &m_geometryPath}) {
+    if (path->empty()) continue;
+    if (std::filesystem::path(*path).filename() == file_name) return true;
+  }
+  return false;
+}
+
+void Shader::Reload() {
+  // a newer edit supersedes a reload still in flight
+  if (m_pendingProgram) {
+    checkStages(m_pendingProgram, m_pendingStages);
+    glDeleteProgram(m_pendingProgram);
+    m_pendingProgram = 0;
+  }
+  std::string vertexCode, fragmentCode, geometryCode;
+  if (!readSources(vertexCode, fragmentCode, geometryCode)) return;
+  m_pendingProgram = glCreateProgram();
+  m_pendingCacheFile = programCacheFile(vertexCode, fragmentCode,
+                                        geometryCode);
+  compileStages(m_pendingProgram, vertexCode, fragmentCode, geometryCode,
+                m_pendingStages);
+  if (!m_pendingCacheFile.empty())
+    glProgramParameteri(m_pendingProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                        GL_TRUE);
+  // without parallel compile support, the driver may block here or at the
+  // first status query in PollReload()
+  glLinkProgram(m_pendingProgram);
+}
+
+bool Shader::PollReload() {
+  if (!m_pendingProgram) return false;
+  if (GLExt().parallel_shader_compile) {
+    GLint done = GL_FALSE;
+    glGetProgramiv(m_pendingProgram, GL_COMPLETION_STATUS_KHR, &done);
+    if (!done) return false;
+  }
+  unsigned int program = m_pendingProgram;
+  m_pendingProgram = 0;
+  if (!checkStages(program, m_pendingStages)) {
+    std::cerr << "ERROR::SHADER::RELOAD_FAILED, keeping the previous program: "
+              << m_vertexPath << ", " << m_fragmentPath << std::endl;
+    glDeleteProgram(program);
+    return false;
+  }
+  if (!m_pendingCacheFile.empty())
+    saveProgramBinary(program, m_pendingCacheFile);
+  // swap in the new program
+  GLState::Instance().ForgetProgram(ID);
+  glDeleteProgram(ID);
+  ID = program;
+  BindUniformBlocks(ID);
+  reflectUniforms();
+  std::cout << "reloaded shader: " << m_vertexPath << ", " << m_fragmentPath
+            << std::endl;
+  return true;
+}
+
+std::string Shader::programCacheFile(const std::string &vertexCode,
+                                     const std::string &fragmentCode,
+                                     const std::string &geometryCode) {
+  const std::string &dir = Config::Instance().shader_cache_dir;
+  if (dir.empty() || !GLExt().program_binary) return "";
+  // a binary is only valid for the exact sources and driver build
+  uint64_t h = Fnv1a(vertexCode);
+  h = Fnv1a("\x01" + fragmentCode, h);
+  h = Fnv1a("\x02" + geometryCode, h);
+  h = Fnv1a(GLString(GL_VENDOR), h);
+  h = Fnv1a(GLString(GL_RENDERER), h);
+  h = Fnv1a(GLString(GL_VERSION), h);
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)h);
+  return dir + "/" + name;
+}
+
+bool Shader::loadProgramBinary(unsigned int program, const std::string &file) {
+  std::ifstream in(file, std::ios::binary);
+  if (!in) return false;
+  char magic[4];
+  GLenum format = 0;
+  in.read(magic, sizeof(magic));
+  in.read((char *)&format, sizeof(format));
+  if (!in || std::memcmp(magic, PROGRAM_BINARY_MAGIC, 4) != 0) return false;
+  std::vector<char> binary((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+  if (binary.empty()) return false;
+  glProgramBinary(program, format, binary.data(), binary.size());
+  GLint success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  // the driver rejects binaries it cannot use; compile from source instead
+  return success;
+}
+
+void Shader::saveProgramBinary(unsigned int program, const std::string &file) {
+  GLint success = 0, length = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (!success || length <= 0) return;
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, NULL, &format, binary.data());
+  std::ofstream out(file, std::ios::binary);
+  out.write(PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC));
+  out.write((const char *)&format, sizeof(format));
+  out.write(binary.data(), binary.size());
+  if (!out)
+    std::cerr << "ERROR::SHADER::PROGRAM_BINARY_NOT_SAVED: " << file
+              << std::endl;
+}
+
+void Shader::Release() {
+  if (m_pendingProgram) {
+    checkStages(m_pendingProgram, m_pendingStages);
+    glDeleteProgram(m_pendingProgram);
+    m_pendingProgram = 0;
+  }
+  GLState::Instance().ForgetProgram(ID);
+  glDeleteProgram(ID);
+  // a reload keeps the serial and the uniform handles, a release drops them
+  MaterialLibrary::Instance().ForgetShader(m_serial);
+}
+
+void Shader::use() const { GLState::Instance().UseProgram(ID); }
+// --------------------------------------------------------------
+namespace {
+// GL type of a uniform that can be set from a C++ value of type T
+template <typename T>
+bool TypeMatches(GLenum type);
+template <>
+bool TypeMatches<int>(GLenum type) {
+  // samplers are set by texture unit number
+  return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D ||
+         type == GL_SAMPLER_2D_ARRAY || type == GL_SAMPLER_CUBE ||
+         type == GL_SAMPLER_2D_SHADOW || type == GL_SAMPLER_2D_ARRAY_SHADOW ||
+         type == GL_SAMPLER_CUBE_SHADOW || type == GL_SAMPLER_BUFFER ||
+         type == GL_INT_SAMPLER_BUFFER ||
+         type == GL_UNSIGNED_INT_SAMPLER_BUFFER ||
+         type == GL_UNSIGNED_INT_SAMPLER_2D;
+}
+template <>
+bool TypeMatches<float>(GLenum type) {
+  return type == GL_FLOAT;
+}
+template <>
+bool TypeMatches<glm::vec2>(GLenum type) {
+  return type == GL_FLOAT_VEC2;
+}
+template <>
+bool TypeMatches<glm::vec3>(GLenum type) {
+  return type == GL_FLOAT_VEC3;
+}
+template <>
+bool TypeMatches<glm::vec4>(GLenum type) {
+  return type == GL_FLOAT_VEC4;
+}
+template <>
+bool TypeMatches<glm::mat2>(GLenum type) {
+  return type == GL_FLOAT_MAT2;
+}
+template <>
+bool TypeMatches<glm::mat3>(GLenum type) {
+  return type == GL_FLOAT_MAT3;
+}
+template <>
+bool TypeMatches<glm::mat4>(GLenum type) {
+  return type == GL_FLOAT_MAT4;
+}
+
+void Upload(GLint location, int value) { glUniform1i(location, value); }
+void Upload(GLint location, float value) { glUniform1f(location, value); }
+void Upload(GLint location, const glm::vec2 &value) {
+  glUniform2fv(location, 1, &value[0]);
+}
+void Upload(GLint location, const glm::vec3 &value) {
+  glUniform3fv(location, 1, &value[0]);
+}
+void Upload(GLint location, const glm::vec4 &value) {
+  glUniform4fv(location, 1, &value[0]);
+}
+void Upload(GLint location, const glm::mat2 &mat) {
+  glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+void Upload(GLint location, const glm::mat3 &mat) {
+  glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+void Upload(GLint location, const glm::mat4 &mat) {
+  glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+}  // namespace
+
+void Shader::reflectUniforms() {
+  // keep the slots of known names, so that handles survive a reload. Uniform
+  // values belong to the program, so the cached ones are void.
+  for (UniformSlot &slot : m_uniforms) {
+    slot.location = -1;
+    slot.type = 0;
+    slot.has_value = false;
+  }
+  GLint count = 0, max_len = 0;
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len);
+  std::vector<GLchar> name(max_len + 1);
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei len = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(ID, i, name.size(), &len, &size, &type, name.data());
+    std::string uniform_name(name.data(), len);
+    GLint location = glGetUniformLocation(ID, uniform_name.c_str());
+    // members of uniform blocks have no location
+    if (location < 0) continue;
+    int index;
+    auto it = m_uniformIndex.find(uniform_name);
+    if (it != m_uniformIndex.end()) {
+      index = it->second;
+    } else {
+      index = m_uniforms.size();
+      m_uniforms.push_back(UniformSlot());
+      m_uniformIndex[uniform_name] = index;
+    }
+    UniformSlot &slot = m_uniforms[index];
+    slot.location = location;
+    slot.type = type;
+    slot.has_value = false;
+    // arrays are reported as "name[0]", also make them reachable as "name"
+    size_t bracket = uniform_name.find('[');
+    if (bracket != std::string::npos)
+      m_uniformIndex[uniform_name.substr(0, bracket)] = index;
+  }
+  // names resolved lazily by uniformIndex() before a reload
+  for (const auto &entry : m_uniformIndex) {
+    UniformSlot &slot = m_uniforms[entry.second];
+    if (slot.location < 0)
+      slot.location = glGetUniformLocation(ID, entry.first.c_str());
+  }
+}
+
+int Shader::uniformIndex(const std::string &name) const {
+  auto it = m_uniformIndex.find(name);
+  if (it != m_uniformIndex.end()) return it->second;
+  // not reflected, e.g. a later array element: resolve it once and remember
+  UniformSlot slot;
+  slot.location = glGetUniformLocation(ID, name.c_str());
+  slot.type = 0;
+  slot.has_value = false;
+  int index = m_uniforms.size();
+  m_uniforms.push_back(slot);
+  m_uniformIndex[name] = index;
+  return index;
+}
+
+template <typename T>
+UniformHandle<T> Shader::GetUniform(const std::string &name) const {
+  UniformHandle<T> handle;
+  int index = uniformIndex(name);
+  const UniformSlot &slot = m_uniforms[index];
+  if (slot.location < 0) return handle;
+  if (slot.type != 0 && !TypeMatches<T>(slot.type)) {
+    std::cerr << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << std::endl;
+    return handle;
+  }
+  handle.index = index;
+  return handle;
+}
+
+template <typename T>
+void Shader::set(UniformHandle<T> handle, const T &value) const {
+  static_assert(sizeof(T) <= sizeof(UniformSlot::value),
+                "uniform value too large for the cache");
+  if (!handle.valid()) return;
+  UniformSlot &slot = m_uniforms[handle.index];
+  if (slot.location < 0) return;
+  // glUniform* writes to the program in use: the cache only describes this
+  // program if it is the one
+  const bool current = GLState::Instance().Program() == ID;
+  assert(current && "Shader::set() needs the program in use");
+  if (!current) {
+    slot.has_value = false;
+    Upload(slot.location, value);
+    return;
+  }
+  if (slot.has_value && std::memcmp(slot.value, &value, sizeof(T)) == 0)
+    return;
+  std::memcpy(slot.value, &value, sizeof(T));
+  slot.has_value = true;
+  Upload(slot.location, value);
 }
 
-void Shader::Release() { glDeleteProgram(ID); }
+#define INSTANTIATE_UNIFORM_TYPE(T)                                     \
+  template UniformHandle<T> Shader::GetUniform<T>(const std::string &) \
+      const;                                                          \
+  template void Shader::set<T>(UniformHandle<T>, const T &) const;
+INSTANTIATE_UNIFORM_TYPE(int)
+INSTANTIATE_UNIFORM_TYPE(float)
+INSTANTIATE_UNIFORM_TYPE(glm::vec2)
+INSTANTIATE_UNIFORM_TYPE(glm::vec3)
+INSTANTIATE_UNIFORM_TYPE(glm::vec4)
+INSTANTIATE_UNIFORM_TYPE(glm::mat2)
+INSTANTIATE_UNIFORM_TYPE(glm::mat3)
+INSTANTIATE_UNIFORM_TYPE(glm::mat4)
+#undef INSTANTIATE_UNIFORM_TYPE
 
-void Shader::use() const { glUseProgram(ID); }
 // --------------------------------------------------------------
+// the named setters go through the same table: a hash lookup instead of
+// glGetUniformLocation, and no upload if the value did not change.
 void Shader::setBool(const std::string &name, bool value) const {
-  glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+  set(UniformHandle<int>{uniformIndex(name)}, (int)value);
 }
 void Shader::setInt(const std::string &name, int value) const {
-  glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+  set(UniformHandle<int>{uniformIndex(name)}, value);
 }
 void Shader::setFloat(const std::string &name, float value) const {
-  glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+  set(UniformHandle<float>{uniformIndex(name)}, value);
 }
 // --------------------------------------------------------------
 void Shader::setVec2(const std::string &name, float x, float y) const {
-  glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+  setVec2(name, glm::vec2(x, y));
 }
 void Shader::setVec2(const std::string &name, const glm::vec2 &value) const {
-  glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+  set(UniformHandle<glm::vec2>{uniformIndex(name)}, value);
 }
 // ----------------------------------------------------------------------
 void Shader::setVec3(const std::string &name, float x, float y, float z) const {
-  glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+  setVec3(name, glm::vec3(x, y, z));
 }
 void Shader::setVec3(const std::string &name, const glm::vec3 &value) const {
-  glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+  set(UniformHandle<glm::vec3>{uniformIndex(name)}, value);
 }
 // --------------------------------------------------------------------------------
 void Shader::setVec4(const std::string &name, float x, float y, float z,
                      float w) const {
-  glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+  setVec4(name, glm::vec4(x, y, z, w));
 }
 void Shader::setVec4(const std::string &name, const glm::vec4 &value) const {
-  glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+  set(UniformHandle<glm::vec4>{uniformIndex(name)}, value);
 }
 // -----------------------------------------------------------------
 void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const {
-  glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-                     &mat[0][0]);
+  set(UniformHandle<glm::mat2>{uniformIndex(name)}, mat);
 }
 void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const {
-  glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-                     &mat[0][0]);
+  set(UniformHandle<glm::mat3>{uniformIndex(name)}, mat);
 }
 void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const {
-  glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-                     &mat[0][0]);
+  set(UniformHandle<glm::mat4>{uniformIndex(name)}, mat);
 }
 
-void Shader::checkCompileErrors(unsigned int shader, std::string type) {
+bool Shader::checkCompileErrors(unsigned int shader, std::string type) {
   GLint success;
   GLchar info_log[1024];
   if (type != "PROGRAM") {
@@ -149,4 +540,5 @@ void Shader::checkCompileErrors(unsigned int shader, std::string type) {
                 << info_log << std::endl;
     }
   }
+  return success;
 }
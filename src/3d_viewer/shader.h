@@ -3,16 +3,58 @@
 
 #include <glm/glm.hpp>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+/** pre-resolved handle to a uniform of type T, see Shader::GetUniform()
+ */
+template <typename T>
+struct UniformHandle {
+  int index = -1;  // slot in the shader's uniform table, -1 if not active
+  bool valid() const { return index >= 0; }
+};
 
 class Shader {
  public:
   unsigned int ID;  // program id
 
+  /** defines are inserted as "#define <define>" after the #version line of
+   * every stage, e.g. "HAS_NORMAL_MAP" or "PCF_KERNEL 2"
+   */
   Shader(const char *vertexPath, const char *fragmentPath,
-         const char *geometryPath = nullptr);
+         const char *geometryPath = nullptr,
+         const std::vector<std::string> &defines = {});
 
   void use() const;
   void Release();
+  /** unique per Shader object and kept across reloads, unlike ID which the
+   * driver may hand out again after Release()
+   */
+  unsigned long Serial() const { return m_serial; }
+
+  /** true if file_name is the name of one of the source files
+   */
+  bool UsesFile(const std::string &file_name) const;
+  /** Recompile from the source files without waiting for the driver. The
+   * current program stays in use until PollReload() swaps in the new one.
+   */
+  void Reload();
+  /** call once per frame: swap in the reloaded program once it is linked,
+   * or drop it and keep the current one if it failed. Returns true if the
+   * program changed.
+   */
+  bool PollReload();
+
+  /** Resolve a uniform once, for use in the per-frame path. Supported types
+   * are int (also for bool and samplers), float, glm::vec2/3/4 and
+   * glm::mat2/3/4.
+   */
+  template <typename T>
+  UniformHandle<T> GetUniform(const std::string &name) const;
+  /** upload value unless it equals the last value set through this shader
+   */
+  template <typename T>
+  void set(UniformHandle<T> handle, const T &value) const;
 
   void setBool(const std::string &name, bool value) const;
   void setInt(const std::string &name, int value) const;
@@ -33,7 +75,47 @@ class Shader {
   void setMat4(const std::string &name, const glm::mat4 &mat) const;
 
  private:
-  void checkCompileErrors(unsigned int shader, std::string type);
+  std::string m_vertexPath, m_fragmentPath, m_geometryPath;
+  std::vector<std::string> m_defines;
+  unsigned long m_serial;
+  // program being compiled by Reload()
+  unsigned int m_pendingProgram;
+  std::vector<unsigned int> m_pendingStages;
+  std::string m_pendingCacheFile;
+
+  /** an active uniform and the last value uploaded to it
+   */
+  struct UniformSlot {
+    int location;
+    unsigned int type;  // GL type, 0 if not reflected
+    bool has_value;
+    unsigned char value[sizeof(glm::mat4)];
+  };
+  // uniform table, filled by reflection at link time. Names that are not
+  // active uniforms (e.g. optimized out) get a slot with location -1. Slots
+  // are never removed, so handles stay valid across reloads.
+  mutable std::vector<UniformSlot> m_uniforms;
+  mutable std::unordered_map<std::string, int> m_uniformIndex;
+
+  bool checkCompileErrors(unsigned int shader, std::string type);
+  bool readSources(std::string &vertexCode, std::string &fragmentCode,
+                   std::string &geometryCode) const;
+  // compile the stages and attach them to program, without checking
+  static void compileStages(unsigned int program,
+                            const std::string &vertexCode,
+                            const std::string &fragmentCode,
+                            const std::string &geometryCode,
+                            std::vector<unsigned int> &stages);
+  // report compile and link errors, then delete the stages
+  bool checkStages(unsigned int program, std::vector<unsigned int> &stages);
+  // program binary cache in Config::shader_cache_dir, "" if disabled
+  static std::string programCacheFile(const std::string &vertexCode,
+                                      const std::string &fragmentCode,
+                                      const std::string &geometryCode);
+  static bool loadProgramBinary(unsigned int program, const std::string &file);
+  static void saveProgramBinary(unsigned int program, const std::string &file);
+  void reflectUniforms();
+  int uniformIndex(const std::string &name) const;
 };
 
 #endif  // _3D_VIEWER_SHADER_H
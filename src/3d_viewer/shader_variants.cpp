@@ -0,0 +1,60 @@
+#include "shader_variants.h"
+
+#include <iostream>
+
+ShaderVariants::ShaderVariants(const std::string &vertexPath,
+                               const std::string &fragmentPath,
+                               const std::vector<std::string> &feature_defines,
+                               const std::string &geometryPath)
+    : m_vertexPath(vertexPath),
+      m_fragmentPath(fragmentPath),
+      m_geometryPath(geometryPath),
+      m_featureDefines(feature_defines) {}
+
+void ShaderVariants::SetDefines(const std::vector<std::string> &defines) {
+  if (defines == m_defines) return;
+  Release();
+  m_defines = defines;
+}
+
+Shader &ShaderVariants::Get(unsigned int features) {
+  auto it = m_variants.find(features);
+  if (it != m_variants.end()) return *it->second.shader;
+
+  std::vector<std::string> defines = m_defines;
+  for (unsigned int i = 0; i < m_featureDefines.size(); ++i)
+    if (features & (1u << i)) defines.push_back(m_featureDefines[i]);
+  std::unique_ptr<Shader> shader(new Shader(
+      m_vertexPath.c_str(), m_fragmentPath.c_str(),
+      m_geometryPath.empty() ? nullptr : m_geometryPath.c_str(), defines));
+  std::cout << "compiled variant " << features << " of " << m_fragmentPath
+            << std::endl;
+  if (m_init) {
+    shader->use();
+    m_init(*shader);
+  }
+  Shader &res = *shader;
+  m_variants[features].shader = std::move(shader);
+  return res;
+}
+
+void ShaderVariants::ReloadShaders(const std::string &file_name) {
+  for (auto &variant : m_variants)
+    if (variant.second.shader->UsesFile(file_name))
+      variant.second.shader->Reload();
+}
+
+void ShaderVariants::PollShaders() {
+  for (auto &variant : m_variants) {
+    Shader &shader = *variant.second.shader;
+    if (shader.PollReload() && m_init) {
+      shader.use();
+      m_init(shader);
+    }
+  }
+}
+
+void ShaderVariants::Release() {
+  for (auto &variant : m_variants) variant.second.shader->Release();
+  m_variants.clear();
+}
@@ -0,0 +1,97 @@
+#ifndef _3D_VIEWER_SHADER_VARIANTS_H
+#define _3D_VIEWER_SHADER_VARIANTS_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shader.h"
+
+/** a uniform of every variant, see ShaderVariants::GetUniform()
+ */
+template <typename T>
+struct VariantUniform {
+  int id = -1;
+};
+
+/** Programs compiled from the same sources with different #defines. Bit i of
+ * a feature mask turns on feature_defines[i]; the variant of a mask is
+ * compiled the first time it is requested and cached.
+ */
+class ShaderVariants {
+ public:
+  ShaderVariants(const std::string &vertexPath,
+                 const std::string &fragmentPath,
+                 const std::vector<std::string> &feature_defines,
+                 const std::string &geometryPath = "");
+
+  /** defines shared by all variants, e.g. "PCF_KERNEL 2". Changing them
+   * drops the compiled variants.
+   */
+  void SetDefines(const std::vector<std::string> &defines);
+  /** called with each new program in use, e.g. to assign sampler units;
+   * also after a hot reload, since uniform values belong to the program
+   */
+  void SetInitializer(std::function<void(Shader &)> init) {
+    m_init = std::move(init);
+  }
+
+  Shader &Get(unsigned int features);
+  // call f(Shader&) with each compiled variant
+  template <typename F>
+  void ForEach(F f) {
+    for (auto &variant : m_variants) f(*variant.second.shader);
+  }
+
+  /** Name a uniform for the per-frame path. Each variant resolves it into a
+   * UniformHandle the first time it is set, so later frames skip the lookup
+   * by name.
+   */
+  template <typename T>
+  VariantUniform<T> GetUniform(const std::string &name) {
+    VariantUniform<T> uniform;
+    uniform.id = m_uniformNames.size();
+    m_uniformNames.push_back(name);
+    return uniform;
+  }
+  /** use each compiled variant and set the uniform in it
+   */
+  template <typename T>
+  void set(VariantUniform<T> uniform, const T &value) {
+    for (auto &entry : m_variants) {
+      Variant &variant = entry.second;
+      if (variant.handles.size() <= (size_t)uniform.id)
+        variant.handles.resize(m_uniformNames.size(), UNRESOLVED);
+      int &index = variant.handles[uniform.id];
+      if (index == UNRESOLVED)
+        index = variant.shader->GetUniform<T>(m_uniformNames[uniform.id]).index;
+      UniformHandle<T> handle;
+      handle.index = index;
+      variant.shader->use();
+      variant.shader->set(handle, value);
+    }
+  }
+
+  void ReloadShaders(const std::string &file_name);
+  void PollShaders();
+  void Release();
+
+ private:
+  std::string m_vertexPath, m_fragmentPath, m_geometryPath;
+  std::vector<std::string> m_featureDefines;
+  std::vector<std::string> m_defines;
+  std::function<void(Shader &)> m_init;
+  // handles[i] is the UniformHandle index of m_uniformNames[i] in shader,
+  // resolved on first use; they stay valid across reloads
+  static const int UNRESOLVED = -2;
+  struct Variant {
+    std::unique_ptr<Shader> shader;
+    std::vector<int> handles;
+  };
+  std::unordered_map<unsigned int, Variant> m_variants;
+  std::vector<std::string> m_uniformNames;
+};
+
+#endif  // _3D_VIEWER_SHADER_VARIANTS_H
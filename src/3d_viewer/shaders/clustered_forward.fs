@@ -0,0 +1,108 @@
+#version 330 core
+// lit pass of ClusteredForwardScheme: each fragment is shaded with the
+// lights of its cluster
+out vec4 FragColor;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+#ifdef HAS_NORMAL_MAP
+    mat3 TBN;
+#endif
+#ifdef HAS_VERTEX_COLOR
+    vec4 Color;
+#endif
+} fs_in;
+
+// cluster grid, defined by ClusteredForwardScheme
+#ifndef CLUSTER_X
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#endif
+// fraction of the albedo lit by ambient light
+#define AMBIENT 0.3
+
+uniform sampler2D texture_diffuse1;
+#ifdef HAS_NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
+uniform usamplerBuffer clusters;      // (first index, count) per cluster
+uniform usamplerBuffer lightIndices;  // light lists of all clusters
+uniform samplerBuffer lights;         // three texels per Light
+uniform vec2 tileSize;                // pixels per cluster column and row
+uniform vec2 sliceScaleBias;          // slice = log(depth) * x + y
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    ivec4 material;
+    vec4 surface;
+};
+
+vec3 SurfaceNormal()
+{
+#ifdef HAS_NORMAL_MAP
+    vec3 n = texture(texture_normal1, fs_in.TexCoords).rgb * 2.0 - 1.0;
+    return normalize(fs_in.TBN * n);
+#else
+    return normalize(fs_in.Normal);
+#endif
+}
+
+int Cluster()
+{
+    float depth = -(view * vec4(fs_in.FragPos, 1.0)).z;
+    int slice = int(log(max(depth, 1e-6)) * sliceScaleBias.x + sliceScaleBias.y);
+    ivec2 tile = ivec2(gl_FragCoord.xy / tileSize);
+    tile = clamp(tile, ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    return (clamp(slice, 0, CLUSTER_Z - 1) * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x;
+}
+
+void main()
+{
+    vec4 diffuse_texel = texture(texture_diffuse1, fs_in.TexCoords);
+#ifdef HAS_ALPHA_TEST
+    if (diffuse_texel.a < 0.5) discard;
+#endif
+    vec3 color = diffuse_texel.rgb;
+#ifdef HAS_VERTEX_COLOR
+    color *= fs_in.Color.rgb;
+#endif
+    vec3 normal = SurfaceNormal();
+    vec3 viewDir = normalize(viewPos.xyz - fs_in.FragPos);
+    vec3 lighting = AMBIENT * color;
+
+    uvec2 range = texelFetch(clusters, Cluster()).xy;
+    for (uint i = 0u; i < range.y; ++i)
+    {
+        int light = 3 * int(texelFetch(lightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(lights, light);
+        vec4 colorCosInner = texelFetch(lights, light + 1);
+        vec4 directionCosOuter = texelFetch(lights, light + 2);
+        vec3 lightDir = positionRadius.xyz - fs_in.FragPos;
+        float dist = length(lightDir);
+        if (dist >= positionRadius.w)
+            continue;
+        lightDir /= dist;
+        // same falloff as deferred_light.fs
+        float x = dist / positionRadius.w;
+        float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+        float attenuation = window * window / (1.0 + 16.0 * x * x);
+        if (directionCosOuter.w > -1.0)
+            attenuation *= smoothstep(directionCosOuter.w, colorCosInner.w,
+                                      dot(-lightDir, directionCosOuter.xyz));
+        float diff = max(dot(lightDir, normal), 0.0);
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        float spec = diff > 0.0 ? pow(max(dot(normal, halfwayDir), 0.0), surface.y) : 0.0;
+        lighting += attenuation * colorCosInner.rgb * (diff * color + spec * surface.x);
+    }
+    FragColor = vec4(lighting, 1.0);
+}
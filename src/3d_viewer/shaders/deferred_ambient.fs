@@ -0,0 +1,18 @@
+#version 330 core
+// ambient term of DeferredRenderingScheme, over the whole G-buffer
+out vec4 FragColor;
+
+// fraction of the albedo lit by ambient light
+#define AMBIENT 0.3
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gDepth;
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    // keep the background
+    if (texelFetch(gDepth, p, 0).r == 1.0)
+        discard;
+    FragColor = vec4(AMBIENT * texelFetch(gAlbedoSpec, p, 0).rgb, 1.0);
+}
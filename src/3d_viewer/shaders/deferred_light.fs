@@ -0,0 +1,68 @@
+#version 330 core
+// one light of DeferredRenderingScheme over the pixels of its volume, added
+// to the framebuffer
+out vec4 FragColor;
+
+flat in vec4 PositionRadius;
+flat in vec4 ColorCosInner;
+flat in vec4 DirectionCosOuter;
+
+// keep in sync with gbuffer.fs
+#define MAX_LOG_SHININESS 11.0
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+uniform mat4 invViewProjection;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+// inverse of OctEncode() in gbuffer.fs
+vec3 OctDecode(vec2 e)
+{
+    e = 2.0 * e - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, p, 0).r;
+    if (depth == 1.0)
+        discard;
+    vec2 uv = gl_FragCoord.xy / vec2(textureSize(gDepth, 0));
+    vec4 world = invViewProjection * vec4(2.0 * vec3(uv, depth) - 1.0, 1.0);
+    vec3 fragPos = world.xyz / world.w;
+
+    vec3 lightDir = PositionRadius.xyz - fragPos;
+    float dist = length(lightDir);
+    if (dist >= PositionRadius.w)
+        discard;
+    lightDir /= dist;
+    // inverse square falloff, windowed to reach 0 at the radius
+    float x = dist / PositionRadius.w;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    float attenuation = window * window / (1.0 + 16.0 * x * x);
+    if (DirectionCosOuter.w > -1.0)
+        attenuation *= smoothstep(DirectionCosOuter.w, ColorCosInner.w,
+                                  dot(-lightDir, DirectionCosOuter.xyz));
+
+    vec4 albedoSpec = texelFetch(gAlbedoSpec, p, 0);
+    vec4 normalShininess = texelFetch(gNormalShininess, p, 0);
+    vec3 normal = OctDecode(normalShininess.xy);
+    float shininess = exp2(normalShininess.z * MAX_LOG_SHININESS);
+    float diff = max(dot(lightDir, normal), 0.0);
+    vec3 viewDir = normalize(viewPos.xyz - fragPos);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = diff > 0.0 ? pow(max(dot(normal, halfwayDir), 0.0), shininess) : 0.0;
+    vec3 lighting = diff * albedoSpec.rgb + spec * albedoSpec.a;
+    FragColor = vec4(attenuation * ColorCosInner.rgb * lighting, 1.0);
+}
@@ -1,6 +1,14 @@
 #version 330 core
+#ifdef HAS_ALPHA_TEST
+in vec2 TexCoords;
+uniform sampler2D texture_diffuse1;
+#endif
 
 void main()
 {             
+#ifdef HAS_ALPHA_TEST
+    if (texture(texture_diffuse1, TexCoords).a < 0.5)
+        discard;
+#endif
     // gl_FragDepth = gl_FragCoord.z;
-}
\ No newline at end of file
+}
@@ -1,10 +1,33 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+#ifdef HAS_ALPHA_TEST
+layout (location = 2) in vec2 aTexCoords;
+out vec2 TexCoords;
+#endif
+// per-instance transform, the identity for meshes without instances
+layout (location = 6) in mat4 aInstance;
 
-uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+#define MAX_CASCADES 4
+layout (std140) uniform LightData {
+    mat4 cascadeMatrices[MAX_CASCADES];
+    vec4 cascadeSplits;
+    vec4 lightPos;
+    ivec4 cascades;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    ivec4 material;
+};
+
+// layer of the shadow map array being rendered
+uniform int cascade;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = cascadeMatrices[cascade] * model * aInstance * vec4(aPos, 1.0);
+#ifdef HAS_ALPHA_TEST
+    TexCoords = aTexCoords;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,33 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+#ifdef HAS_ALPHA_TEST
+layout (location = 2) in vec2 aTexCoords;
+out vec2 TexCoords;
+#endif
+// per-instance transform, the identity for meshes without instances
+layout (location = 6) in mat4 aInstance;
+
+// the lit pass computes the same depths to the bit and tests GL_EQUAL
+invariant gl_Position;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    ivec4 material;
+};
+
+void main()
+{
+    // same expression as in shadow_rendering.vs
+    mat4 M = model * aInstance;
+    gl_Position = projection * view * M * vec4(aPos, 1.0);
+#ifdef HAS_ALPHA_TEST
+    TexCoords = aTexCoords;
+#endif
+}
@@ -0,0 +1,24 @@
+#version 330 core
+// one direction of a separable 9-tap gaussian blur of a texture array layer
+out vec4 Result;
+
+uniform sampler2DArray source;
+uniform int layer;
+uniform vec2 direction;  // (1, 0) or (0, 1)
+
+const float weights[5] = float[](0.2270270, 0.1945946, 0.1216216, 0.0540540, 0.0162162);
+
+void main()
+{
+    ivec2 size = textureSize(source, 0).xy;
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    ivec2 offset = ivec2(direction);
+    Result = weights[0] * texelFetch(source, ivec3(p, layer), 0);
+    for (int i = 1; i < 5; ++i)
+    {
+        ivec2 a = clamp(p + i * offset, ivec2(0), size - 1);
+        ivec2 b = clamp(p - i * offset, ivec2(0), size - 1);
+        Result += weights[i] * (texelFetch(source, ivec3(a, layer), 0) +
+                                texelFetch(source, ivec3(b, layer), 0));
+    }
+}
@@ -0,0 +1,30 @@
+#version 330 core
+// exponential variance shadow map moments of one shadow map layer, averaged
+// over downsample x downsample depth texels
+out vec4 Moments;
+
+// keep in sync with shadow_rendering.fs
+#define EVSM_POSITIVE 40.0
+#define EVSM_NEGATIVE 5.0
+
+uniform sampler2DArray depthMap;
+uniform int layer;
+uniform int downsample;
+
+void main()
+{
+    ivec2 base = ivec2(gl_FragCoord.xy) * downsample;
+    vec4 sum = vec4(0.0);
+    for (int y = 0; y < downsample; ++y)
+    {
+        for (int x = 0; x < downsample; ++x)
+        {
+            float depth = texelFetch(depthMap, ivec3(base + ivec2(x, y), layer), 0).r;
+            depth = 2.0 * depth - 1.0;
+            float pos = exp(EVSM_POSITIVE * depth);
+            float neg = -exp(-EVSM_NEGATIVE * depth);
+            sum += vec4(pos, pos * pos, neg, neg * neg);
+        }
+    }
+    Moments = sum / float(downsample * downsample);
+}
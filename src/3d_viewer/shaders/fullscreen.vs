@@ -0,0 +1,8 @@
+#version 330 core
+// one triangle covering the viewport, drawn with 3 vertices and no buffers
+
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(2.0 * p - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,65 @@
+#version 330 core
+// geometry pass of DeferredRenderingScheme, see deferred_scheme.h for the
+// G-buffer layout
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec4 gNormalShininess;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+#ifdef HAS_NORMAL_MAP
+    mat3 TBN;
+#endif
+#ifdef HAS_VERTEX_COLOR
+    vec4 Color;
+#endif
+} fs_in;
+
+// shininess up to 2^MAX_LOG_SHININESS, keep in sync with deferred_light.fs
+#define MAX_LOG_SHININESS 11.0
+
+uniform sampler2D texture_diffuse1;
+#ifdef HAS_NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    ivec4 material;
+    vec4 surface;
+};
+
+// unit vector to [0, 1]^2: the octahedron |x| + |y| + |z| = 1 unfolded onto
+// the square, the lower half folded over the corners
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0,
+                                     n.y >= 0.0 ? 1.0 : -1.0);
+    return 0.5 * e + 0.5;
+}
+
+void main()
+{
+    vec4 diffuse_texel = texture(texture_diffuse1, fs_in.TexCoords);
+#ifdef HAS_ALPHA_TEST
+    if (diffuse_texel.a < 0.5) discard;
+#endif
+    vec3 color = diffuse_texel.rgb;
+#ifdef HAS_VERTEX_COLOR
+    color *= fs_in.Color.rgb;
+#endif
+#ifdef HAS_NORMAL_MAP
+    vec3 n = texture(texture_normal1, fs_in.TexCoords).rgb * 2.0 - 1.0;
+    vec3 normal = normalize(fs_in.TBN * n);
+#else
+    vec3 normal = normalize(fs_in.Normal);
+#endif
+    gAlbedoSpec = vec4(color, clamp(surface.x, 0.0, 1.0));
+    float shininess = clamp(log2(max(surface.y, 1.0)) / MAX_LOG_SHININESS, 0.0, 1.0);
+    gNormalShininess = vec4(OctEncode(normal), shininess, 0.0);
+}
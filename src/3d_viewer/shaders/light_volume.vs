@@ -0,0 +1,25 @@
+#version 330 core
+// bounding volume of a point or spot light, one instance per Light
+layout (location = 0) in vec3 aPos;  // on a polyhedron around the unit sphere
+layout (location = 1) in vec4 aPositionRadius;
+layout (location = 2) in vec4 aColorCosInner;
+layout (location = 3) in vec4 aDirectionCosOuter;
+
+flat out vec4 PositionRadius;
+flat out vec4 ColorCosInner;
+flat out vec4 DirectionCosOuter;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+void main()
+{
+    PositionRadius = aPositionRadius;
+    ColorCosInner = aColorCosInner;
+    DirectionCosOuter = aDirectionCosOuter;
+    vec3 p = aPositionRadius.xyz + aPositionRadius.w * aPos;
+    gl_Position = projection * view * vec4(p, 1.0);
+}
@@ -4,9 +4,13 @@ layout (location = 1) in vec3 aColor;
 
 out vec3 Color;
 
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
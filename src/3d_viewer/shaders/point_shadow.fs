@@ -0,0 +1,103 @@
+#version 330 core
+// lit pass of PointLightShadowScheme: one point light with a cube shadow map
+out vec4 FragColor;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+#ifdef HAS_NORMAL_MAP
+    mat3 TBN;
+#endif
+#ifdef HAS_VERTEX_COLOR
+    vec4 Color;
+#endif
+} fs_in;
+
+uniform sampler2D texture_diffuse1;
+#ifdef HAS_NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
+// depth of the cube faces, compared by the sampler
+uniform samplerCubeShadow shadowMap;
+// near and far plane of the cube faces; the light reaches the far plane
+uniform vec2 lightRange;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+#define MAX_CASCADES 4
+layout (std140) uniform LightData {
+    mat4 cascadeMatrices[MAX_CASCADES];
+    vec4 cascadeSplits;
+    vec4 lightPos;
+    ivec4 cascades;
+};
+
+vec3 SurfaceNormal()
+{
+#ifdef HAS_NORMAL_MAP
+    vec3 n = texture(texture_normal1, fs_in.TexCoords).rgb * 2.0 - 1.0;
+    return normalize(fs_in.TBN * n);
+#else
+    return normalize(fs_in.Normal);
+#endif
+}
+
+// depth a face of the cube map stores for the light-to-point vector d: the
+// perspective depth of its major axis
+float CubeDepth(vec3 d)
+{
+    float z = max(abs(d.x), max(abs(d.y), abs(d.z)));
+    float n = lightRange.x, f = lightRange.y;
+    float ndc = (f + n) / (f - n) - 2.0 * f * n / ((f - n) * z);
+    return 0.5 * ndc + 0.5;
+}
+
+float ShadowCalculation(vec3 normal)
+{
+    vec3 d = fs_in.FragPos - lightPos.xyz;
+    float z = max(abs(d.x), max(abs(d.y), abs(d.z)));
+    if (z >= lightRange.y)
+        return 0.0;
+    // look up from about a texel off the surface, the texel growing with
+    // the distance to the light
+    float texel = 2.0 * z / float(textureSize(shadowMap, 0).x);
+    d += 1.5 * texel * normal;
+    return 1.0 - texture(shadowMap, vec4(d, CubeDepth(d)));
+}
+
+void main() {
+  vec4 diffuse_texel = texture(texture_diffuse1, fs_in.TexCoords);
+#ifdef HAS_ALPHA_TEST
+  if (diffuse_texel.a < 0.5) discard;
+#endif
+  vec3 color = diffuse_texel.rgb;
+#ifdef HAS_VERTEX_COLOR
+  color *= fs_in.Color.rgb;
+#endif
+  vec3 normal = SurfaceNormal();
+  // fades out smoothly at the range of the light
+  float dist = length(lightPos.xyz - fs_in.FragPos);
+  float window = clamp(1.0 - pow(dist / lightRange.y, 4.0), 0.0, 1.0);
+  vec3 lightColor = vec3(0.7) * window * window;
+  // ambient
+  vec3 ambient = 0.3 * color;
+  // diffuse
+  vec3 lightDir = normalize(lightPos.xyz - fs_in.FragPos);
+  float diff = max(dot(lightDir, normal), 0.0);
+  vec3 diffuse = diff * lightColor;
+  // specular
+  vec3 viewDir = normalize(viewPos.xyz - fs_in.FragPos);
+  vec3 halfwayDir = normalize(lightDir + viewDir);
+  float spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
+  vec3 specular = spec * lightColor;
+  // calculate shadow
+  float shadow = ShadowCalculation(normal);
+  vec3 lighting = ambient + (1.0 - shadow) * (diffuse + specular) * color;
+
+  FragColor = vec4(lighting, 1.0);
+}
@@ -0,0 +1,51 @@
+#version 330 core
+// all six faces of a point light's cube shadow map in one pass: each
+// triangle is sent to the layer of every face its mesh casts into
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+#ifdef HAS_ALPHA_TEST
+in vec2 vTexCoords[];
+out vec2 TexCoords;
+#endif
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    ivec4 material;
+};
+
+// world to clip space of each face, in cube map face order
+uniform mat4 faceMatrices[6];
+// per object: bit f is set if its bounds reach face f
+uniform usamplerBuffer faceMasks;
+
+void main()
+{
+    uint mask = texelFetch(faceMasks, material.y).r;
+    for (int face = 0; face < 6; ++face)
+    {
+        if ((mask & (1u << uint(face))) == 0u)
+            continue;
+        vec4 p[3];
+        for (int i = 0; i < 3; ++i)
+            p[i] = faceMatrices[face] * gl_in[i].gl_Position;
+        // skip triangles beyond a side plane of the face
+        vec3 x = vec3(p[0].x, p[1].x, p[2].x);
+        vec3 y = vec3(p[0].y, p[1].y, p[2].y);
+        vec3 w = vec3(p[0].w, p[1].w, p[2].w);
+        if (all(greaterThan(x, w)) || all(lessThan(x, -w)) ||
+            all(greaterThan(y, w)) || all(lessThan(y, -w)))
+            continue;
+        for (int i = 0; i < 3; ++i)
+        {
+            gl_Layer = face;
+            gl_Position = p[i];
+#ifdef HAS_ALPHA_TEST
+            TexCoords = vTexCoords[i];
+#endif
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
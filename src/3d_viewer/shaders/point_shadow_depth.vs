@@ -0,0 +1,24 @@
+#version 330 core
+// world-space positions for point_shadow_depth.gs, which projects them to
+// the faces of the cube shadow map
+layout (location = 0) in vec3 aPos;
+#ifdef HAS_ALPHA_TEST
+layout (location = 2) in vec2 aTexCoords;
+out vec2 vTexCoords;
+#endif
+// per-instance transform, the identity for meshes without instances
+layout (location = 6) in mat4 aInstance;
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    ivec4 material;
+};
+
+void main()
+{
+    gl_Position = model * aInstance * vec4(aPos, 1.0);
+#ifdef HAS_ALPHA_TEST
+    vTexCoords = aTexCoords;
+#endif
+}
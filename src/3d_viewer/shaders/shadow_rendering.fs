@@ -5,70 +5,214 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+#ifdef HAS_NORMAL_MAP
+    mat3 TBN;
+#endif
+#ifdef HAS_VERTEX_COLOR
+    vec4 Color;
+#endif
 } fs_in;
 
+// PCF averages (2 * PCF_KERNEL + 1)^2 shadow map texels
+#ifndef PCF_KERNEL
+#define PCF_KERNEL 1
+#endif
+// shadow filters, see DirectionalLightingShadowScheme::ShadowFilter
+#define FILTER_PCF_GRID 0      // (2k+1)^2 depth comparisons
+#define FILTER_PCF_HARDWARE 1  // (2k)^2 bilinear comparisons by the sampler
+#define FILTER_PCF_POISSON 2   // rotated Poisson disk, with early out
+#define FILTER_EVSM 3          // exponential variance shadow map
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER FILTER_PCF_GRID
+#endif
+// keep in sync with evsm_convert.fs
+#define EVSM_POSITIVE 40.0
+#define EVSM_NEGATIVE 5.0
+#define EVSM_BLEED 0.2  // light bleeding reduction
+
 uniform sampler2D texture_diffuse1;
-uniform sampler2D shadowMap;
+#ifdef HAS_NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
+// one layer per cascade: depth, or EVSM moments
+#if SHADOW_FILTER == FILTER_PCF_HARDWARE
+uniform sampler2DArrayShadow shadowMap;
+#else
+uniform sampler2DArray shadowMap;
+#endif
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+#define MAX_CASCADES 4
+layout (std140) uniform LightData {
+    mat4 cascadeMatrices[MAX_CASCADES];
+    vec4 cascadeSplits;
+    vec4 lightPos;
+    ivec4 cascades;
+};
 
-float ShadowCalculation(vec4 fragPosLightSpace)
+vec3 SurfaceNormal()
 {
-    // perform perspective divide
-    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    // transform to [0,1] range
-    projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
-    // get depth of current fragment from light's perspective
-    float currentDepth = projCoords.z;
-    // calculate bias (based on depth map resolution and slope)
-    vec3 normal = normalize(fs_in.Normal);
-    vec3 lightDir = normalize(lightPos - fs_in.FragPos);
-    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
-    // check whether current frag pos is in shadow
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
+#ifdef HAS_NORMAL_MAP
+    vec3 n = texture(texture_normal1, fs_in.TexCoords).rgb * 2.0 - 1.0;
+    return normalize(fs_in.TBN * n);
+#else
+    return normalize(fs_in.Normal);
+#endif
+}
+
+// the first cascade whose far split lies beyond the fragment
+int SelectCascade()
+{
+    float depth = -(view * vec4(fs_in.FragPos, 1.0)).z;
+    for (int i = 0; i < cascades.x - 1; ++i)
+        if (depth < cascadeSplits[i])
+            return i;
+    return cascades.x - 1;
+}
+
+#if SHADOW_FILTER == FILTER_PCF_POISSON
+const vec2 poissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790));
+
+// per-pixel noise in [0, 1), turns the banding of a fixed disk into noise
+float InterleavedGradientNoise(vec2 p)
+{
+    return fract(52.9829189 * fract(dot(p, vec2(0.06711056, 0.00583715))));
+}
+#endif
+
+#if SHADOW_FILTER == FILTER_EVSM
+// upper bound of the lit fraction from the mean and variance of the warped
+// depths around the texel
+float Chebyshev(vec2 moments, float mean, float min_variance)
+{
+    if (mean <= moments.x)
+        return 1.0;
+    float variance = max(moments.y - moments.x * moments.x, min_variance);
+    float d = mean - moments.x;
+    float p = variance / (variance + d * d);
+    return clamp((p - EVSM_BLEED) / (1.0 - EVSM_BLEED), 0.0, 1.0);
+}
+#endif
+
+// shadowed fraction of the fragment at coords (uv, depth) of a cascade
+float FilterShadow(vec3 coords, int cascade, float bias)
+{
+    float ref = coords.z - bias;
+#if SHADOW_FILTER == FILTER_PCF_HARDWARE
+    // each tap blends the comparisons of 2x2 texels, (2k)^2 taps half a
+    // texel off the grid cover the footprint of the (2k+1)^2 grid
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0).xy;
+    float lit = 0.0;
+    for (int x = -PCF_KERNEL; x < PCF_KERNEL; ++x)
+        for (int y = -PCF_KERNEL; y < PCF_KERNEL; ++y)
+        {
+            vec2 uv = coords.xy + (vec2(x, y) + 0.5) * texelSize;
+            lit += texture(shadowMap, vec4(uv, cascade, ref));
+        }
+    return 1.0 - lit / float(4 * PCF_KERNEL * PCF_KERNEL);
+#elif SHADOW_FILTER == FILTER_PCF_POISSON
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0).xy;
+    float angle = 6.2831853 * InterleavedGradientNoise(gl_FragCoord.xy);
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    vec2 radius = (float(PCF_KERNEL) + 0.5) * texelSize;
+    float shadow = 0.0;
+    // the first taps spread over the whole disk: if they agree, the
+    // fragment is far from a shadow edge
+    for (int i = 0; i < 4; ++i)
+    {
+        vec2 uv = coords.xy + rotation * poissonDisk[i] * radius;
+        shadow += ref > texture(shadowMap, vec3(uv, cascade)).r ? 1.0 : 0.0;
+    }
+    if (shadow == 0.0 || shadow == 4.0)
+        return shadow / 4.0;
+    for (int i = 4; i < 16; ++i)
+    {
+        vec2 uv = coords.xy + rotation * poissonDisk[i] * radius;
+        shadow += ref > texture(shadowMap, vec3(uv, cascade)).r ? 1.0 : 0.0;
+    }
+    return shadow / 16.0;
+#elif SHADOW_FILTER == FILTER_EVSM
+    // the filtered moments replace the bias
+    vec4 moments = texture(shadowMap, vec3(coords.xy, cascade));
+    float depth = 2.0 * coords.z - 1.0;
+    vec2 warped = vec2(exp(EVSM_POSITIVE * depth), -exp(-EVSM_NEGATIVE * depth));
+    vec2 min_variance = 1e-4 * vec2(EVSM_POSITIVE, EVSM_NEGATIVE) * warped;
+    min_variance *= min_variance;
+    float lit = min(Chebyshev(moments.xy, warped.x, min_variance.x),
+                    Chebyshev(moments.zw, warped.y, min_variance.y));
+    return 1.0 - lit;
+#else
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0).xy;
+    for(int x = -PCF_KERNEL; x <= PCF_KERNEL; ++x)
     {
-        for(int y = -1; y <= 1; ++y)
+        for(int y = -PCF_KERNEL; y <= PCF_KERNEL; ++y)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
+            vec2 uv = coords.xy + vec2(x, y) * texelSize;
+            float pcfDepth = texture(shadowMap, vec3(uv, cascade)).r;
+            shadow += ref > pcfDepth  ? 1.0 : 0.0;        
         }    
     }
-    shadow /= 9.0;
-    
+    return shadow / float((2 * PCF_KERNEL + 1) * (2 * PCF_KERNEL + 1));
+#endif
+}
+
+float ShadowCalculation(vec3 normal)
+{
+    int cascade = SelectCascade();
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fs_in.FragPos, 1.0);
+    // perform perspective divide
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
     // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
     if(projCoords.z > 1.0)
-        shadow = 0.0;
-        
-    return shadow;
+        return 0.0;
+    // calculate bias (based on depth map resolution and slope)
+    vec3 lightDir = normalize(lightPos.xyz - fs_in.FragPos);
+    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+    return FilterShadow(projCoords, cascade, bias);
 }
 
 void main() {
-  vec3 color = texture(texture_diffuse1, fs_in.TexCoords).rgb;
-  vec3 normal = normalize(fs_in.Normal);
+  vec4 diffuse_texel = texture(texture_diffuse1, fs_in.TexCoords);
+#ifdef HAS_ALPHA_TEST
+  if (diffuse_texel.a < 0.5) discard;
+#endif
+  vec3 color = diffuse_texel.rgb;
+#ifdef HAS_VERTEX_COLOR
+  color *= fs_in.Color.rgb;
+#endif
+  vec3 normal = SurfaceNormal();
   vec3 lightColor = vec3(0.3);
   // ambient
   vec3 ambient = 0.3 * color;
   // diffuse
-  vec3 lightDir = normalize(lightPos - fs_in.FragPos);
+  vec3 lightDir = normalize(lightPos.xyz - fs_in.FragPos);
   float diff = max(dot(lightDir, normal), 0.0);
   vec3 diffuse = diff * lightColor;
   // specular
-  vec3 viewDir = normalize(viewPos - fs_in.FragPos);
+  vec3 viewDir = normalize(viewPos.xyz - fs_in.FragPos);
   vec3 reflectDir = reflect(-lightDir, normal);
   float spec = 0.0;
   vec3 halfwayDir = normalize(lightDir + viewDir);
   spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
   vec3 specular = spec * lightColor;
   // calculate shadow
-  float shadow = ShadowCalculation(fs_in.FragPosLightSpace);
+  float shadow = ShadowCalculation(normal);
   vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;
 
   FragColor = vec4(lighting, 1.0);
@@ -2,6 +2,16 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef HAS_NORMAL_MAP
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+#endif
+#ifdef HAS_VERTEX_COLOR
+layout (location = 5) in vec4 aColor;
+#endif
+// per-instance transform, the identity for meshes without instances.
+// Instances are rigid with uniform scale: normals use the upper 3x3
+layout (location = 6) in mat4 aInstance;
 
 // out vec2 TexCoords;
 
@@ -9,19 +19,51 @@ out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+#ifdef HAS_NORMAL_MAP
+    mat3 TBN;
+#endif
+#ifdef HAS_VERTEX_COLOR
+    vec4 Color;
+#endif
 } vs_out;
+// equal to the depth prepass, see depth_prepass.vs
+invariant gl_Position;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+#define MAX_CASCADES 4
+layout (std140) uniform LightData {
+    mat4 cascadeMatrices[MAX_CASCADES];
+    vec4 cascadeSplits;
+    vec4 lightPos;
+    ivec4 cascades;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    ivec4 material;
+    vec4 surface;  // declared in full for the fragment shaders reading it
+};
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
-    vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
+    mat4 M = model * aInstance;
+    mat3 N = mat3(normalMatrix) * mat3(aInstance);
+    vs_out.FragPos = vec3(M * vec4(aPos, 1.0));
+    vs_out.Normal = N * aNormal;
     vs_out.TexCoords = aTexCoords;
-    vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef HAS_NORMAL_MAP
+    vec3 T = normalize(N * aTangent);
+    vec3 B = normalize(N * aBitangent);
+    vs_out.TBN = mat3(T, B, normalize(vs_out.Normal));
+#endif
+#ifdef HAS_VERTEX_COLOR
+    vs_out.Color = aColor;
+#endif
+    gl_Position = projection * view * M * vec4(aPos, 1.0);
 }
\ No newline at end of file
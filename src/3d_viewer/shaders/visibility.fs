@@ -0,0 +1,17 @@
+#version 330 core
+// (draw id, triangle) of the visible surface of each pixel
+layout (location = 0) out uvec2 Visibility;
+
+flat in uint DrawId;
+#ifdef HAS_ALPHA_TEST
+in vec2 TexCoords;
+uniform sampler2D texture_diffuse1;
+#endif
+
+void main()
+{
+#ifdef HAS_ALPHA_TEST
+    if (texture(texture_diffuse1, TexCoords).a < 0.5) discard;
+#endif
+    Visibility = uvec2(DrawId, uint(gl_PrimitiveID));
+}
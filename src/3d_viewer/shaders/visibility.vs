@@ -0,0 +1,37 @@
+#version 330 core
+// visibility pass of VisibilityBufferScheme: positions only, plus the UVs of
+// alpha-tested meshes
+layout (location = 0) in vec3 aPos;
+#ifdef HAS_ALPHA_TEST
+layout (location = 2) in vec2 aTexCoords;
+out vec2 TexCoords;
+#endif
+// per-instance transform, the identity for meshes without instances
+layout (location = 6) in mat4 aInstance;
+
+// keep in sync with VisibilityBufferScheme::INSTANCE_BITS
+#define INSTANCE_BITS 20
+// object index + 1 (0 is the background) above the instance index
+flat out uint DrawId;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    ivec4 material;
+};
+
+void main()
+{
+    DrawId = uint(material.y + 1) << INSTANCE_BITS | uint(gl_InstanceID);
+    mat4 M = model * aInstance;
+    gl_Position = projection * view * M * vec4(aPos, 1.0);
+#ifdef HAS_ALPHA_TEST
+    TexCoords = aTexCoords;
+#endif
+}
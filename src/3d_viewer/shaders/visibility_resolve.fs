@@ -0,0 +1,151 @@
+#version 330 core
+// resolve pass of VisibilityBufferScheme: rebuilds the visible triangle of
+// each pixel from the vertex buffers, then textures and lights it once
+out vec4 FragColor;
+
+// keep in sync with visibility.vs
+#define INSTANCE_BITS 20
+// fraction of the albedo lit by ambient light
+#define AMBIENT 0.3
+// ObjectModel::Feature
+#define HAS_NORMAL_MAP 1
+#define HAS_VERTEX_COLOR 2
+
+uniform usampler2D visibility;
+// scene buffers, see VisibilityBufferScheme
+uniform samplerBuffer vertices;        // 4 texels per vertex
+uniform usamplerBuffer indices;
+uniform isamplerBuffer meshInfo;       // 2 texels per mesh
+uniform samplerBuffer meshTransforms;  // ObjectUniforms, 10 texels per mesh
+uniform samplerBuffer instances;       // 4 texels per instance
+uniform sampler2DArray diffuseMaps;
+uniform sampler2DArray normalMaps;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+mat4 FetchMat4(samplerBuffer buffer, int i)
+{
+    return mat4(texelFetch(buffer, i), texelFetch(buffer, i + 1),
+                texelFetch(buffer, i + 2), texelFetch(buffer, i + 3));
+}
+
+// perspective-correct barycentrics of a pixel and their change to the next
+// pixel in x and y, from the clip-space corners of its triangle
+struct Barycentrics {
+    vec3 l;
+    vec3 ddx;
+    vec3 ddy;
+};
+
+Barycentrics ComputeBarycentrics(vec4 c0, vec4 c1, vec4 c2, vec2 ndc,
+                                 vec2 size)
+{
+    vec3 invW = 1.0 / vec3(c0.w, c1.w, c2.w);
+    vec2 p0 = c0.xy * invW.x;
+    vec2 p1 = c1.xy * invW.y;
+    vec2 p2 = c2.xy * invW.z;
+    // l / w is affine in NDC: gradients of l_i / w_i
+    float invDet = 1.0 / determinant(mat2(p2 - p1, p0 - p1));
+    vec3 ddx = vec3(p1.y - p2.y, p2.y - p0.y, p0.y - p1.y) * invDet * invW;
+    vec3 ddy = vec3(p2.x - p1.x, p0.x - p2.x, p1.x - p0.x) * invDet * invW;
+    float ddxSum = ddx.x + ddx.y + ddx.z;
+    float ddySum = ddy.x + ddy.y + ddy.z;
+    vec2 d = ndc - p0;
+    float interpInvW = invW.x + d.x * ddxSum + d.y * ddySum;
+    Barycentrics b;
+    b.l = (vec3(invW.x, 0.0, 0.0) + d.x * ddx + d.y * ddy) / interpInvW;
+    // one pixel is 2 / size in NDC
+    ddx *= 2.0 / size.x;
+    ddy *= 2.0 / size.y;
+    ddxSum *= 2.0 / size.x;
+    ddySum *= 2.0 / size.y;
+    b.ddx = (b.l * interpInvW + ddx) / (interpInvW + ddxSum) - b.l;
+    b.ddy = (b.l * interpInvW + ddy) / (interpInvW + ddySum) - b.l;
+    return b;
+}
+
+vec3 Interpolate(vec3 l, vec3 a0, vec3 a1, vec3 a2)
+{
+    return l.x * a0 + l.y * a1 + l.z * a2;
+}
+
+vec2 Interpolate(vec3 l, vec2 a0, vec2 a1, vec2 a2)
+{
+    return l.x * a0 + l.y * a1 + l.z * a2;
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    uvec2 vis = texelFetch(visibility, p, 0).xy;
+    if (vis.x == 0u)
+        discard;
+    int object = int(vis.x >> INSTANCE_BITS) - 1;
+    int instance = int(vis.x & ((1u << INSTANCE_BITS) - 1u));
+    int triangle = int(vis.y);
+
+    // first vertex, first index, first instance, instance count
+    ivec4 info = texelFetch(meshInfo, 2 * object);
+    // diffuse layer, normal layer, features
+    ivec4 maps = texelFetch(meshInfo, 2 * object + 1);
+    mat4 M = FetchMat4(meshTransforms, 10 * object);
+    mat3 N = mat3(FetchMat4(meshTransforms, 10 * object + 4));
+    vec4 surface = texelFetch(meshTransforms, 10 * object + 9);
+    if (info.w > 0)
+    {
+        mat4 I = FetchMat4(instances, 4 * (info.z + instance));
+        M = M * I;
+        N = N * mat3(I);
+    }
+
+    // the triangle's corners: (position, u), (normal, v), (tangent, sign of
+    // the bitangent), color
+    vec4 v[12];
+    for (int k = 0; k < 3; ++k)
+    {
+        int index = info.y + 3 * triangle + k;
+        int vertex = info.x + int(texelFetch(indices, index).r);
+        for (int j = 0; j < 4; ++j)
+            v[4 * k + j] = texelFetch(vertices, 4 * vertex + j);
+    }
+    vec3 w0 = vec3(M * vec4(v[0].xyz, 1.0));
+    vec3 w1 = vec3(M * vec4(v[4].xyz, 1.0));
+    vec3 w2 = vec3(M * vec4(v[8].xyz, 1.0));
+    mat4 VP = projection * view;
+    vec2 size = vec2(textureSize(visibility, 0));
+    vec2 ndc = 2.0 * gl_FragCoord.xy / size - 1.0;
+    Barycentrics b = ComputeBarycentrics(VP * vec4(w0, 1.0), VP * vec4(w1, 1.0),
+                                         VP * vec4(w2, 1.0), ndc, size);
+
+    vec3 fragPos = Interpolate(b.l, w0, w1, w2);
+    vec2 uv0 = vec2(v[0].w, v[1].w);
+    vec2 uv1 = vec2(v[4].w, v[5].w);
+    vec2 uv2 = vec2(v[8].w, v[9].w);
+    vec2 uv = Interpolate(b.l, uv0, uv1, uv2);
+    vec2 uvDx = Interpolate(b.ddx, uv0, uv1, uv2);
+    vec2 uvDy = Interpolate(b.ddy, uv0, uv1, uv2);
+    vec3 color = textureGrad(diffuseMaps, vec3(uv, maps.x), uvDx, uvDy).rgb;
+    if ((maps.z & HAS_VERTEX_COLOR) != 0)
+        color *= Interpolate(b.l, v[3].rgb, v[7].rgb, v[11].rgb);
+    vec3 normal = normalize(N * Interpolate(b.l, v[1].xyz, v[5].xyz, v[9].xyz));
+    if ((maps.z & HAS_NORMAL_MAP) != 0)
+    {
+        vec3 T = normalize(N * Interpolate(b.l, v[2].xyz, v[6].xyz, v[10].xyz));
+        vec3 B = v[2].w * cross(normal, T);
+        vec3 n = textureGrad(normalMaps, vec3(uv, maps.y), uvDx, uvDy).rgb;
+        n = n * 2.0 - 1.0;
+        normal = normalize(mat3(T, B, normal) * n);
+    }
+
+    // a light at the camera
+    vec3 lightDir = normalize(viewPos.xyz - fragPos);
+    float diff = max(dot(lightDir, normal), 0.0);
+    // the half vector of a light at the eye is the light direction
+    float spec = diff > 0.0 ? pow(diff, surface.y) : 0.0;
+    vec3 lighting = AMBIENT * color + 0.7 * (diff * color + spec * surface.x);
+    FragColor = vec4(lighting, 1.0);
+}
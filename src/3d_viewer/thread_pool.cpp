@@ -0,0 +1,59 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int threads)
+    : m_generation(0),
+      m_busy(0),
+      m_stop(false),
+      m_invoke(nullptr),
+      m_body(nullptr),
+      m_count(0),
+      m_next(0) {
+  for (unsigned int i = 1; i < threads; ++i)
+    m_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_start.notify_all();
+  for (std::thread &worker : m_workers) worker.join();
+}
+
+void ThreadPool::run(unsigned int n, void (*invoke)(void *, unsigned int),
+                     void *body) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_invoke = invoke;
+    m_body = body;
+    m_count = n;
+    m_next = 0;
+    m_busy = m_workers.size();
+    ++m_generation;
+  }
+  m_start.notify_all();
+  work();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this] { return m_busy == 0; });
+}
+
+void ThreadPool::work() {
+  for (unsigned int i = m_next++; i < m_count; i = m_next++)
+    m_invoke(m_body, i);
+}
+
+void ThreadPool::workerLoop() {
+  unsigned long generation = 0;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_start.wait(lock,
+                 [&] { return m_stop || m_generation != generation; });
+    if (m_stop) return;
+    generation = m_generation;
+    lock.unlock();
+    work();
+    lock.lock();
+    if (--m_busy == 0) m_done.notify_one();
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef _3D_VIEWER_THREAD_POOL_H
+#define _3D_VIEWER_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Worker threads started once and reused for data-parallel loops, so the
+ * per-frame path neither starts threads nor allocates.
+ */
+class ThreadPool {
+ public:
+  /** threads counts the calling thread, which works too
+   */
+  explicit ThreadPool(
+      unsigned int threads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  unsigned int Size() const { return m_workers.size() + 1; }
+
+  /** call f(i) for each i in [0, n) on any of the threads, and return when
+   * all calls returned
+   */
+  template <typename F>
+  void ParallelFor(unsigned int n, F &f) {
+    run(n, [](void *body, unsigned int i) { (*static_cast<F *>(body))(i); },
+        &f);
+  }
+
+ private:
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_start, m_done;
+  unsigned long m_generation;  // incremented by each job
+  unsigned int m_busy;         // workers still in the current job
+  bool m_stop;
+  // the current job
+  void (*m_invoke)(void *, unsigned int);
+  void *m_body;
+  unsigned int m_count;
+  std::atomic<unsigned int> m_next;  // next index to hand out
+
+  void run(unsigned int n, void (*invoke)(void *, unsigned int), void *body);
+  // take indices of the current job until there are none left
+  void work();
+  void workerLoop();
+};
+
+#endif  // _3D_VIEWER_THREAD_POOL_H
@@ -0,0 +1,77 @@
+#include <glad/glad.h>
+
+#include "uniform_buffer.h"
+
+#include "gl_state.h"
+
+void BindUniformBlocks(unsigned int program) {
+  static const struct {
+    const char *name;
+    UniformBlockBinding binding;
+  } blocks[] = {
+      {"FrameData", FRAME_BLOCK},
+      {"LightData", LIGHT_BLOCK},
+      {"ObjectData", OBJECT_BLOCK},
+  };
+  for (const auto &block : blocks) {
+    GLuint index = glGetUniformBlockIndex(program, block.name);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, index, block.binding);
+  }
+}
+
+void UniformBuffer::Create(unsigned int binding, size_t size) {
+  m_binding = binding;
+  m_size = size;
+  glGenBuffers(1, &m_ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+  glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  Bind();
+}
+
+void UniformBuffer::Release() {
+  GLState::Instance().ForgetUniformBuffer(m_ubo);
+  glDeleteBuffers(1, &m_ubo);
+  m_ubo = 0;
+}
+
+void UniformBuffer::Bind() const {
+  GLState::Instance().BindUniformBuffer(m_binding, m_ubo);
+}
+
+void UniformBuffer::Update(const void *data, size_t size,
+                           size_t offset) const {
+  glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+}
+
+void ObjectUniformBuffer::Create(unsigned int capacity) {
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  m_stride = (sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+  m_capacity = capacity;
+  glGenBuffers(1, &m_ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+  glBufferData(GL_UNIFORM_BUFFER, m_stride * capacity, NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void ObjectUniformBuffer::Release() {
+  GLState::Instance().ForgetUniformBuffer(m_ubo);
+  glDeleteBuffers(1, &m_ubo);
+  m_ubo = 0;
+  m_capacity = 0;
+}
+
+void ObjectUniformBuffer::Update(unsigned int slot,
+                                 const ObjectUniforms &data) const {
+  glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, slot * m_stride, sizeof(ObjectUniforms),
+                  &data);
+}
+
+void ObjectUniformBuffer::Bind(unsigned int slot) const {
+  GLState::Instance().BindUniformBufferRange(
+      OBJECT_BLOCK, m_ubo, slot * m_stride, sizeof(ObjectUniforms));
+}
@@ -0,0 +1,83 @@
+#ifndef _3D_VIEWER_UNIFORM_BUFFER_H
+#define _3D_VIEWER_UNIFORM_BUFFER_H
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/** Binding points of the uniform blocks shared by all programs. Shader binds
+ * the blocks named below to these points after linking.
+ */
+enum UniformBlockBinding {
+  FRAME_BLOCK = 0,  // "FrameData": camera, once per frame
+  LIGHT_BLOCK = 1,  // "LightData": light, once per pass
+  OBJECT_BLOCK = 2,  // "ObjectData": per draw, a range of ObjectUniformBuffer
+};
+
+// std140 mirrors of the uniform blocks; keep in sync with the shaders.
+// Shaders may leave out trailing members they do not read.
+struct FrameUniforms {
+  glm::mat4 projection;
+  glm::mat4 view;
+  glm::vec4 viewPos;  // w unused
+};
+// shadow cascades of the directional light, "MAX_CASCADES" in the shaders
+const int MAX_CASCADES = 4;
+struct LightUniforms {
+  glm::mat4 cascadeMatrices[MAX_CASCADES];  // world to light clip space
+  glm::vec4 cascadeSplits;  // view-space far distance of each cascade
+  glm::vec4 lightPos;       // w unused
+  glm::ivec4 cascades;      // x: cascade count
+};
+struct ObjectUniforms {
+  glm::mat4 model;
+  glm::mat4 normalMatrix;  // mat3 padded to vec4 columns
+  glm::ivec4 material;     // x: material index, y: object index
+  glm::vec4 surface;       // x: specular strength, y: shininess
+};
+
+/** bind the known uniform blocks of a linked program to their binding points
+ */
+void BindUniformBlocks(unsigned int program);
+
+class UniformBuffer {
+ public:
+  UniformBuffer() : m_ubo(0), m_binding(0), m_size(0) {}
+
+  void Create(unsigned int binding, size_t size);
+  void Release();
+  /** attach the buffer to its binding point, skipped if already attached
+   */
+  void Bind() const;
+  void Update(const void *data, size_t size, size_t offset = 0) const;
+  template <typename T>
+  void Update(const T &data) const {
+    Update(&data, sizeof(T));
+  }
+
+ private:
+  unsigned int m_ubo;
+  unsigned int m_binding;
+  size_t m_size;
+};
+
+/** Per-object uniforms of a whole scene in one buffer, one slot per object
+ * padded to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT. A draw selects its object by
+ * binding the slot's range to OBJECT_BLOCK, so no uniform is set per draw.
+ */
+class ObjectUniformBuffer {
+ public:
+  ObjectUniformBuffer() : m_ubo(0), m_stride(0), m_capacity(0) {}
+
+  void Create(unsigned int capacity);
+  void Release();
+  unsigned int Capacity() const { return m_capacity; }
+  void Update(unsigned int slot, const ObjectUniforms &data) const;
+  void Bind(unsigned int slot) const;
+
+ private:
+  unsigned int m_ubo;
+  size_t m_stride;
+  unsigned int m_capacity;
+};
+
+#endif  // _3D_VIEWER_UNIFORM_BUFFER_H
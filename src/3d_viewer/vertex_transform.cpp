@@ -0,0 +1,253 @@
+#include "vertex_transform.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VERTEX_TRANSFORM_X86
+#endif
+
+namespace {
+/** affine map as the columns of its 3x3 part followed by the translation
+ */
+struct Affine {
+  float m[4][3];
+};
+
+// arrays at least this long are split across threads
+const size_t PARALLEL_MIN = 1 << 16;
+
+void KernelScalar(float *p, size_t n, const Affine &A) {
+  const float(*m)[3] = A.m;
+  for (size_t i = 0; i < n; ++i, p += 3) {
+    float x = p[0], y = p[1], z = p[2];
+    p[0] = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+    p[1] = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+    p[2] = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+  }
+}
+
+/** running bounds, lo and hi are updated
+ */
+void BoundsScalar(const float *p, size_t n, float lo[3], float hi[3]) {
+  for (size_t i = 0; i < n; ++i, p += 3)
+    for (int k = 0; k < 3; ++k) {
+      lo[k] = std::min(lo[k], p[k]);
+      hi[k] = std::max(hi[k], p[k]);
+    }
+}
+
+#ifdef VERTEX_TRANSFORM_X86
+/* Four packed vec3 span three registers,
+ *   a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3,
+ * and are transposed to X = x0..x3, Y = y0..y3, Z = z0..z3 and back with
+ * shuffles. The AVX shuffle works on both 128-bit lanes alike, so the same
+ * sequence handles eight vertices there.
+ */
+#define DEINTERLEAVE_XYZ(SHUFFLE, a, b, c, X, Y, Z)            \
+  do {                                                         \
+    auto t_ = SHUFFLE(b, c, _MM_SHUFFLE(0, 1, 3, 2));          \
+    X = SHUFFLE(a, t_, _MM_SHUFFLE(2, 0, 3, 0));               \
+    auto u_ = SHUFFLE(a, b, _MM_SHUFFLE(1, 0, 2, 1));          \
+    auto v_ = SHUFFLE(b, c, _MM_SHUFFLE(3, 2, 0, 3));          \
+    Y = SHUFFLE(u_, v_, _MM_SHUFFLE(2, 0, 2, 0));              \
+    auto w_ = SHUFFLE(c, c, _MM_SHUFFLE(3, 0, 3, 0));          \
+    Z = SHUFFLE(u_, w_, _MM_SHUFFLE(1, 0, 3, 1));              \
+  } while (0)
+
+#define INTERLEAVE_XYZ(SHUFFLE, X, Y, Z, a, b, c)                         \
+  do {                                                                    \
+    a = SHUFFLE(SHUFFLE(X, Y, _MM_SHUFFLE(1, 0, 1, 0)),                   \
+                SHUFFLE(Z, X, _MM_SHUFFLE(1, 1, 0, 0)),                   \
+                _MM_SHUFFLE(2, 0, 2, 0));                                 \
+    b = SHUFFLE(SHUFFLE(Y, Z, _MM_SHUFFLE(1, 1, 1, 1)),                   \
+                SHUFFLE(X, Y, _MM_SHUFFLE(2, 2, 2, 2)),                   \
+                _MM_SHUFFLE(2, 0, 2, 0));                                 \
+    c = SHUFFLE(SHUFFLE(Z, X, _MM_SHUFFLE(3, 3, 2, 2)),                   \
+                SHUFFLE(Y, Z, _MM_SHUFFLE(3, 3, 3, 3)),                   \
+                _MM_SHUFFLE(2, 0, 2, 0));                                 \
+  } while (0)
+
+void KernelSSE(float *p, size_t n, const Affine &A) {
+  __m128 m[4][3];
+  for (int c = 0; c < 4; ++c)
+    for (int r = 0; r < 3; ++r) m[c][r] = _mm_set1_ps(A.m[c][r]);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4, p += 12) {
+    __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4),
+           c = _mm_loadu_ps(p + 8);
+    __m128 X, Y, Z;
+    DEINTERLEAVE_XYZ(_mm_shuffle_ps, a, b, c, X, Y, Z);
+    __m128 out[3];
+    for (int r = 0; r < 3; ++r)
+      out[r] = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(m[0][r], X), _mm_mul_ps(m[1][r], Y)),
+          _mm_add_ps(_mm_mul_ps(m[2][r], Z), m[3][r]));
+    INTERLEAVE_XYZ(_mm_shuffle_ps, out[0], out[1], out[2], a, b, c);
+    _mm_storeu_ps(p, a);
+    _mm_storeu_ps(p + 4, b);
+    _mm_storeu_ps(p + 8, c);
+  }
+  KernelScalar(p, n - i, A);
+}
+
+// vertices 0-3 go to the low lane, 4-7 to the high lane
+__attribute__((target("avx"))) inline __m256 LoadBlocks(const float *q) {
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(q)),
+                              _mm_loadu_ps(q + 12), 1);
+}
+
+__attribute__((target("avx"))) inline void StoreBlocks(float *q, __m256 v) {
+  _mm_storeu_ps(q, _mm256_castps256_ps128(v));
+  _mm_storeu_ps(q + 12, _mm256_extractf128_ps(v, 1));
+}
+
+__attribute__((target("avx"))) void KernelAVX(float *p, size_t n,
+                                                const Affine &A) {
+  __m256 m[4][3];
+  for (int c = 0; c < 4; ++c)
+    for (int r = 0; r < 3; ++r) m[c][r] = _mm256_set1_ps(A.m[c][r]);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8, p += 24) {
+    __m256 a = LoadBlocks(p), b = LoadBlocks(p + 4), c = LoadBlocks(p + 8);
+    __m256 X, Y, Z;
+    DEINTERLEAVE_XYZ(_mm256_shuffle_ps, a, b, c, X, Y, Z);
+    __m256 out[3];
+    for (int r = 0; r < 3; ++r)
+      out[r] = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(m[0][r], X), _mm256_mul_ps(m[1][r], Y)),
+          _mm256_add_ps(_mm256_mul_ps(m[2][r], Z), m[3][r]));
+    INTERLEAVE_XYZ(_mm256_shuffle_ps, out[0], out[1], out[2], a, b, c);
+    StoreBlocks(p, a);
+    StoreBlocks(p + 4, b);
+    StoreBlocks(p + 8, c);
+  }
+  KernelSSE(p, n - i, A);
+}
+/* Bounds need no transpose: lane j of the registers a, b, c always holds
+ * the same component (x y z x, y z x y, z x y z), so they are reduced as is
+ * and the lanes are merged per component at the end.
+ */
+void BoundsSSE(const float *p, size_t n, float lo[3], float hi[3]) {
+  if (n < 4) {
+    BoundsScalar(p, n, lo, hi);
+    return;
+  }
+  __m128 lo_a = _mm_loadu_ps(p), lo_b = _mm_loadu_ps(p + 4),
+         lo_c = _mm_loadu_ps(p + 8);
+  __m128 hi_a = lo_a, hi_b = lo_b, hi_c = lo_c;
+  size_t i = 4;
+  const float *q = p + 12;
+  for (; i + 4 <= n; i += 4, q += 12) {
+    __m128 a = _mm_loadu_ps(q), b = _mm_loadu_ps(q + 4),
+           c = _mm_loadu_ps(q + 8);
+    lo_a = _mm_min_ps(lo_a, a);
+    lo_b = _mm_min_ps(lo_b, b);
+    lo_c = _mm_min_ps(lo_c, c);
+    hi_a = _mm_max_ps(hi_a, a);
+    hi_b = _mm_max_ps(hi_b, b);
+    hi_c = _mm_max_ps(hi_c, c);
+  }
+  float l[12], h[12];
+  _mm_storeu_ps(l, lo_a);
+  _mm_storeu_ps(l + 4, lo_b);
+  _mm_storeu_ps(l + 8, lo_c);
+  _mm_storeu_ps(h, hi_a);
+  _mm_storeu_ps(h + 4, hi_b);
+  _mm_storeu_ps(h + 8, hi_c);
+  // float j of the 12 holds component j % 3
+  BoundsScalar(l, 4, lo, hi);
+  BoundsScalar(h, 4, lo, hi);
+  BoundsScalar(q, n - i, lo, hi);
+}
+#endif  // VERTEX_TRANSFORM_X86
+
+typedef void (*Kernel)(float *, size_t, const Affine &);
+typedef void (*BoundsKernel)(const float *, size_t, float[3], float[3]);
+
+struct KernelChoice {
+  Kernel kernel;
+  BoundsKernel bounds;
+  const char *name;
+};
+
+const KernelChoice &PickKernel() {
+  static const KernelChoice choice = []() -> KernelChoice {
+#ifdef VERTEX_TRANSFORM_X86
+    // bounds are bound by memory bandwidth, SSE is enough
+    if (__builtin_cpu_supports("avx")) return {KernelAVX, BoundsSSE, "avx"};
+    if (__builtin_cpu_supports("sse")) return {KernelSSE, BoundsSSE, "sse"};
+#endif
+    return {KernelScalar, BoundsScalar, "scalar"};
+  }();
+  return choice;
+}
+
+// number of threads for an array of n elements, 1 below PARALLEL_MIN
+unsigned int ThreadCount(size_t n) {
+  unsigned int threads = std::thread::hardware_concurrency();
+  if (n < PARALLEL_MIN || threads < 2) return 1;
+  return std::min<size_t>(threads, n / (PARALLEL_MIN / 4));
+}
+
+void Run(glm::vec3 *v, size_t n, const Affine &A) {
+  if (n == 0) return;
+  Kernel kernel = PickKernel().kernel;
+  float *p = &v[0].x;
+  unsigned int threads = ThreadCount(n);
+  if (threads == 1) {
+    kernel(p, n, A);
+    return;
+  }
+  // chunks of whole AVX blocks, the last one takes the rest
+  size_t chunk = (n / threads) & ~size_t(7);
+  std::vector<std::thread> workers;
+  for (unsigned int t = 0; t + 1 < threads; ++t)
+    workers.emplace_back(kernel, p + 3 * t * chunk, chunk, std::cref(A));
+  size_t done = (threads - 1) * chunk;
+  kernel(p + 3 * done, n - done, A);
+  for (std::thread &w : workers) w.join();
+}
+}  // namespace
+
+void TransformPoints(glm::vec3 *points, size_t n, const glm::mat4 &T) {
+  Affine A;
+  for (int c = 0; c < 4; ++c)
+    for (int r = 0; r < 3; ++r) A.m[c][r] = T[c][r];
+  Run(points, n, A);
+}
+
+void TransformVectors(glm::vec3 *vectors, size_t n, const glm::mat3 &M) {
+  Affine A;
+  for (int c = 0; c < 3; ++c)
+    for (int r = 0; r < 3; ++r) A.m[c][r] = M[c][r];
+  A.m[3][0] = A.m[3][1] = A.m[3][2] = 0.0f;
+  Run(vectors, n, A);
+}
+
+void ComputeBounds(const glm::vec3 *points, size_t n, glm::vec3 &lo,
+                   glm::vec3 &hi, bool parallel) {
+  BoundsKernel bounds = PickKernel().bounds;
+  const float *p = &points[0].x;
+  unsigned int threads = parallel ? ThreadCount(n) : 1;
+  // per-thread partial bounds, merged below
+  std::vector<glm::vec3> partial(2 * threads, points[0]);
+  size_t chunk = (n / threads) & ~size_t(3);
+  std::vector<std::thread> workers;
+  for (unsigned int t = 0; t + 1 < threads; ++t)
+    workers.emplace_back(bounds, p + 3 * t * chunk, chunk, &partial[2 * t].x,
+                         &partial[2 * t + 1].x);
+  size_t done = (threads - 1) * chunk;
+  bounds(p + 3 * done, n - done, &partial[2 * threads - 2].x,
+         &partial[2 * threads - 1].x);
+  for (std::thread &w : workers) w.join();
+  lo = hi = points[0];
+  for (unsigned int t = 0; t < threads; ++t) {
+    lo = glm::min(lo, partial[2 * t]);
+    hi = glm::max(hi, partial[2 * t + 1]);
+  }
+}
+
+const char *TransformKernelName() { return PickKernel().name; }
@@ -0,0 +1,29 @@
+#ifndef _3D_VIEWER_VERTEX_TRANSFORM_H
+#define _3D_VIEWER_VERTEX_TRANSFORM_H
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/** Bulk operations on vec3 arrays. The kernels use AVX or SSE, picked at
+ * runtime, and split large arrays across threads.
+ */
+
+/** points[i] = T * (points[i], 1)
+ */
+void TransformPoints(glm::vec3 *points, size_t n, const glm::mat4 &T);
+/** vectors[i] = M * vectors[i], without normalization. Use mat3(T) for
+ * tangents and transpose(inverse(mat3(T))) for normals.
+ */
+void TransformVectors(glm::vec3 *vectors, size_t n, const glm::mat3 &M);
+
+/** component-wise min and max of n > 0 points; on the calling thread only
+ * unless parallel, e.g. when called from several threads already
+ */
+void ComputeBounds(const glm::vec3 *points, size_t n, glm::vec3 &lo,
+                   glm::vec3 &hi, bool parallel = true);
+
+/** name of the kernel picked for this CPU, e.g. "avx"
+ */
+const char *TransformKernelName();
+
+#endif  // _3D_VIEWER_VERTEX_TRANSFORM_H
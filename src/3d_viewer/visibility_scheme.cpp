@@ -0,0 +1,352 @@
+#include <glad/glad.h>
+
+#include "visibility_scheme.h"
+
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "config.h"
+#include "gl_state.h"
+#include "gl_util.h"
+
+static const std::string& res_dir() { return Config::Instance().shader_dir; }
+
+/** RGBA8 texture array of the given textures resampled to size x size, after
+ * a white layer if white_first; layer i + white_first holds textures[i]
+ */
+static unsigned int CreateMapArray(const std::vector<unsigned int>& textures,
+                                   int size, bool white_first) {
+  GLState& gl_state = GLState::Instance();
+  const int layers = textures.size() + (white_first ? 1 : 0);
+  unsigned int array;
+  glGenTextures(1, &array);
+  gl_state.BindTexture(GL_TEXTURE_2D_ARRAY, array);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size, size,
+               std::max(layers, 1), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  // copy each map into its layer, scaling on the way
+  unsigned int fbos[2];
+  glGenFramebuffers(2, fbos);
+  gl_state.BindFramebuffer(fbos[1]);
+  if (white_first) {
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0,
+                              0);
+    const float white[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glClearBufferfv(GL_COLOR, 0, white);
+  }
+  gl_state.BindReadFramebuffer(fbos[0]);
+  for (size_t i = 0; i < textures.size(); ++i) {
+    GLint width = 0, height = 0;
+    gl_state.BindTexture(GL_TEXTURE_2D, textures[i]);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, textures[i], 0);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0,
+                              i + (white_first ? 1 : 0));
+    glBlitFramebuffer(0, 0, width, height, 0, 0, size, size,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  }
+  gl_state.BindReadFramebuffer(0);
+  gl_state.BindFramebuffer(0);
+  gl_state.ForgetFramebuffer(fbos[0]);
+  gl_state.ForgetFramebuffer(fbos[1]);
+  glDeleteFramebuffers(2, fbos);
+  gl_state.BindTexture(GL_TEXTURE_2D_ARRAY, array);
+  glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  return array;
+}
+
+VisibilityBufferScheme::VisibilityBufferScheme()
+    : visibilityShader(res_dir() + "/visibility.vs",
+                       res_dir() + "/visibility.fs",
+                       ObjectModel::FeatureDefines()),
+      resolveShader((res_dir() + "/fullscreen.vs").c_str(),
+                    (res_dir() + "/visibility_resolve.fs").c_str()),
+      m_visibility(0),
+      m_depth(0),
+      m_targetWidth(0),
+      m_targetHeight(0),
+      m_diffuseMaps(0),
+      m_normalMaps(0),
+      m_sceneSerial(0) {
+  glGenFramebuffers(1, &visibilityFBO);
+  glGenVertexArrays(1, &m_emptyVAO);
+  CreateTextureBuffer(GL_RGBA32F, GL_STATIC_DRAW, m_vertexTex, m_vertexTBO);
+  CreateTextureBuffer(GL_R32UI, GL_STATIC_DRAW, m_indexTex, m_indexTBO);
+  CreateTextureBuffer(GL_RGBA32I, GL_STATIC_DRAW, m_meshInfoTex,
+                      m_meshInfoTBO);
+  CreateTextureBuffer(GL_RGBA32F, GL_STATIC_DRAW, m_transformTex,
+                      m_transformTBO);
+  CreateTextureBuffer(GL_RGBA32F, GL_STATIC_DRAW, m_instanceTex,
+                      m_instanceTBO);
+  m_visibilitySampler = resolveShader.GetUniform<int>("visibility");
+  m_vertexSampler = resolveShader.GetUniform<int>("vertices");
+  m_indexSampler = resolveShader.GetUniform<int>("indices");
+  m_meshInfoSampler = resolveShader.GetUniform<int>("meshInfo");
+  m_transformSampler = resolveShader.GetUniform<int>("meshTransforms");
+  m_instanceSampler = resolveShader.GetUniform<int>("instances");
+  m_diffuseSampler = resolveShader.GetUniform<int>("diffuseMaps");
+  m_normalSampler = resolveShader.GetUniform<int>("normalMaps");
+  m_shaders = {&resolveShader};
+  m_shaderVariants = {&visibilityShader};
+}
+
+VisibilityBufferScheme::VisibilityBufferScheme(const SceneModel* model,
+                                               Navigation* nav)
+    : VisibilityBufferScheme() {
+  SetModel(model);
+  SetNavigation(nav);
+  InitNavigationFromBBox();
+}
+
+VisibilityBufferScheme::~VisibilityBufferScheme() {
+  GLState& gl_state = GLState::Instance();
+  releaseTargets();
+  gl_state.ForgetFramebuffer(visibilityFBO);
+  gl_state.ForgetVertexArray(m_emptyVAO);
+  glDeleteFramebuffers(1, &visibilityFBO);
+  glDeleteVertexArrays(1, &m_emptyVAO);
+  DeleteTextureBuffer(m_vertexTex, m_vertexTBO);
+  DeleteTextureBuffer(m_indexTex, m_indexTBO);
+  DeleteTextureBuffer(m_meshInfoTex, m_meshInfoTBO);
+  DeleteTextureBuffer(m_transformTex, m_transformTBO);
+  DeleteTextureBuffer(m_instanceTex, m_instanceTBO);
+  for (unsigned int* array : {&m_diffuseMaps, &m_normalMaps}) {
+    gl_state.ForgetTexture(*array);
+    glDeleteTextures(1, array);
+  }
+  visibilityShader.Release();
+  resolveShader.Release();
+  m_visibilityTimer.Release();
+  m_resolveTimer.Release();
+}
+
+void VisibilityBufferScheme::resizeTargets(int width, int height) {
+  releaseTargets();
+  m_targetWidth = width;
+  m_targetHeight = height;
+  m_visibility = CreateTarget(width, height, GL_RG32UI, GL_RG_INTEGER,
+                              GL_UNSIGNED_INT);
+  // same format as the default framebuffer's depth, for the blit
+  m_depth = CreateTarget(width, height, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+                         GL_UNSIGNED_INT_24_8);
+  GLState::Instance().BindFramebuffer(visibilityFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_visibility, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                         GL_TEXTURE_2D, m_depth, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "visibility framebuffer is not complete" << std::endl;
+}
+
+void VisibilityBufferScheme::releaseTargets() {
+  for (unsigned int* texture : {&m_visibility, &m_depth}) {
+    if (*texture == 0) continue;
+    GLState::Instance().ForgetTexture(*texture);
+    glDeleteTextures(1, texture);
+    *texture = 0;
+  }
+}
+
+void VisibilityBufferScheme::buildMaterialMaps() {
+  GLState& gl_state = GLState::Instance();
+  for (unsigned int* array : {&m_diffuseMaps, &m_normalMaps}) {
+    gl_state.ForgetTexture(*array);
+    glDeleteTextures(1, array);
+  }
+  // one layer per distinct texture, shared by the materials using it
+  const MaterialLibrary& library = MaterialLibrary::Instance();
+  std::vector<unsigned int> diffuse, normal;
+  std::map<unsigned int, int> diffuse_layer, normal_layer;
+  m_diffuseLayers.assign(library.Size(), 0);  // white
+  m_normalLayers.assign(library.Size(), -1);
+  for (unsigned int i = 0; i < library.Size(); ++i) {
+    const Material& m = library[i];
+    if (!m.textures[Material::DIFFUSE].empty()) {
+      unsigned int tex = m.textures[Material::DIFFUSE][0];
+      auto it = diffuse_layer.emplace(tex, diffuse.size() + 1).first;
+      if (it->second == (int)diffuse.size() + 1) diffuse.push_back(tex);
+      m_diffuseLayers[i] = it->second;
+    }
+    if (!m.textures[Material::NORMAL].empty()) {
+      unsigned int tex = m.textures[Material::NORMAL][0];
+      auto it = normal_layer.emplace(tex, normal.size()).first;
+      if (it->second == (int)normal.size()) normal.push_back(tex);
+      m_normalLayers[i] = it->second;
+    }
+  }
+  m_diffuseMaps = CreateMapArray(diffuse, MAP_SIZE, true);
+  m_normalMaps = CreateMapArray(normal, MAP_SIZE, false);
+}
+
+void VisibilityBufferScheme::buildScene() {
+  const std::vector<ObjectModel>& meshes = m_model->meshes;
+  buildMaterialMaps();
+  std::vector<glm::vec4> vertices;
+  std::vector<unsigned int> indices;
+  m_drawable.assign(meshes.size(), 0);
+  m_meshInfo.assign(2 * meshes.size(), glm::ivec4(0));
+  for (unsigned int i = 0; i < meshes.size() && i < MAX_MESHES; ++i) {
+    const ObjectModel& mesh = meshes[i];
+    if (mesh.primitive_type != ObjectModel::TRIANGLES) continue;
+    const size_t v_num = mesh.positions.size();
+    const unsigned int features = mesh.Features();
+    m_drawable[i] = 1;
+    m_meshInfo[2 * i].x = vertices.size() / 4;
+    m_meshInfo[2 * i].y = indices.size();
+    m_meshInfo[2 * i + 1] =
+        glm::ivec4(m_diffuseLayers[mesh.material],
+                   m_normalLayers[mesh.material], features, 0);
+    if (m_normalLayers[mesh.material] < 0)
+      m_meshInfo[2 * i + 1].z &= ~ObjectModel::HAS_NORMAL_MAP;
+    const bool has_uv = mesh.tex_coords.size() == v_num;
+    for (size_t v = 0; v < v_num; ++v) {
+      glm::vec2 uv = has_uv ? mesh.tex_coords[v] : glm::vec2(0.0f);
+      glm::vec3 n = v < mesh.normals.size() ? mesh.normals[v] : glm::vec3(0);
+      glm::vec4 tangent(0.0f), color(1.0f);
+      if (features & ObjectModel::HAS_NORMAL_MAP) {
+        const glm::vec3& t = mesh.tangents[v];
+        float sign = glm::dot(glm::cross(n, t), mesh.bitangents[v]);
+        tangent = glm::vec4(t, sign < 0.0f ? -1.0f : 1.0f);
+      }
+      if (features & ObjectModel::HAS_VERTEX_COLOR) color = mesh.colors[v];
+      vertices.insert(vertices.end(), {glm::vec4(mesh.positions[v], uv.x),
+                                       glm::vec4(n, uv.y), tangent, color});
+    }
+    // triangle t is drawn as gl_PrimitiveID t, also by the merged position
+    // stream, which keeps the order of the triangles
+    if (mesh.indices.empty())
+      for (unsigned int v = 0; v < v_num; ++v) indices.push_back(v);
+    else
+      indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+  }
+  UploadBuffer(m_vertexTBO, GL_STATIC_DRAW, vertices.data(),
+               vertices.size() * sizeof(glm::vec4));
+  UploadBuffer(m_indexTBO, GL_STATIC_DRAW, indices.data(),
+               indices.size() * sizeof(unsigned int));
+  // forces the upload of all transforms and instances
+  m_transformVersions.assign(meshes.size(), ~0u);
+  m_instanceVersions.assign(meshes.size(), ~0u);
+  m_sceneSerial = m_modelSerial;
+}
+
+void VisibilityBufferScheme::updateTransforms() {
+  const std::vector<ObjectModel>& meshes = m_model->meshes;
+  bool changed = false;
+  for (unsigned int i = 0; i < meshes.size(); ++i)
+    changed |= m_transformVersions[i] != meshes[i].TransformVersion();
+  if (!changed) return;
+  std::vector<ObjectUniforms> transforms(meshes.size());
+  for (unsigned int i = 0; i < meshes.size(); ++i) {
+    m_transformVersions[i] = meshes[i].TransformVersion();
+    transforms[i] = ObjectData(i);
+  }
+  UploadBuffer(m_transformTBO, GL_STATIC_DRAW, transforms.data(),
+               transforms.size() * sizeof(ObjectUniforms));
+}
+
+void VisibilityBufferScheme::updateInstances() {
+  const std::vector<ObjectModel>& meshes = m_model->meshes;
+  bool changed = false;
+  for (unsigned int i = 0; i < meshes.size(); ++i)
+    changed |= m_instanceVersions[i] != meshes[i].InstanceVersion();
+  if (!changed) return;
+  // the offsets move with the instance counts, so rebuild all
+  std::vector<glm::mat4> instances;
+  for (unsigned int i = 0; i < meshes.size(); ++i) {
+    const ObjectModel& mesh = meshes[i];
+    m_instanceVersions[i] = mesh.InstanceVersion();
+    m_meshInfo[2 * i].z = instances.size();
+    m_meshInfo[2 * i].w = mesh.InstanceCount();
+    instances.insert(instances.end(), mesh.Instances().begin(),
+                     mesh.Instances().end());
+    if (mesh.primitive_type == ObjectModel::TRIANGLES && i < MAX_MESHES)
+      m_drawable[i] = mesh.InstanceCount() <= MAX_INSTANCES;
+  }
+  UploadBuffer(m_instanceTBO, GL_STATIC_DRAW, instances.data(),
+               instances.size() * sizeof(glm::mat4));
+  UploadBuffer(m_meshInfoTBO, GL_STATIC_DRAW, m_meshInfo.data(),
+               m_meshInfo.size() * sizeof(glm::ivec4));
+}
+
+void VisibilityBufferScheme::Render() {
+  GLState& gl_state = GLState::Instance();
+  const GLint* viewport = gl_state.Viewport();
+  const GLint width = viewport[2], height = viewport[3];
+  if (width != m_targetWidth || height != m_targetHeight)
+    resizeTargets(width, height);
+  if (m_sceneSerial != m_modelSerial) buildScene();
+  updateTransforms();
+  updateInstances();
+
+  Camera& cam = m_navigation->camera();
+  glm::mat4 projection =
+      glm::perspective(glm::radians(cam.Zoom), (float)width / (float)height,
+                       cam.near_plane, cam.far_plane);
+  const glm::mat4 view = cam.GetViewMatrix();
+  m_renderQueue.Clear();
+  // positions only, front to back
+  SubmitModel(RenderQueue::DEPTH, visibilityShader, view, cam.near_plane,
+              cam.far_plane, &m_drawable, ObjectModel::HAS_ALPHA_TEST);
+  m_renderQueue.Sort();
+  FrameUniforms frame;
+  frame.projection = projection;
+  frame.view = view;
+  frame.viewPos = glm::vec4(cam.Position(), 1.0f);
+  m_frameBlock.Bind();
+  m_frameBlock.Update(frame);
+  UpdateObjectBlock();
+
+  // 1. visibility pass: triangle ids into the visibility buffer
+  // --------------------------------------------------------------
+  m_visibilityTimer.Begin();
+  gl_state.BindFramebuffer(visibilityFBO);
+  glEnable(GL_DEPTH_TEST);
+  const GLuint background[4] = {0, 0, 0, 0};
+  glClearBufferuiv(GL_COLOR, 0, background);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  m_renderQueue.Draw(RenderQueue::DEPTH, &m_objectBlock);
+  m_visibilityTimer.End();
+
+  // 2. resolve: fetch, interpolate and shade the triangle of each pixel
+  // --------------------------------------------------------------
+  m_resolveTimer.Begin();
+  // later passes can draw over the result
+  gl_state.BindFramebuffer(0);
+  gl_state.BindReadFramebuffer(visibilityFBO);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  gl_state.BindReadFramebuffer(0);
+  glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  gl_state.BindTexture(0, GL_TEXTURE_2D, m_visibility);
+  gl_state.BindTexture(1, GL_TEXTURE_BUFFER, m_vertexTex);
+  gl_state.BindTexture(2, GL_TEXTURE_BUFFER, m_indexTex);
+  gl_state.BindTexture(3, GL_TEXTURE_BUFFER, m_meshInfoTex);
+  gl_state.BindTexture(4, GL_TEXTURE_BUFFER, m_transformTex);
+  gl_state.BindTexture(5, GL_TEXTURE_BUFFER, m_instanceTex);
+  gl_state.BindTexture(6, GL_TEXTURE_2D_ARRAY, m_diffuseMaps);
+  gl_state.BindTexture(7, GL_TEXTURE_2D_ARRAY, m_normalMaps);
+  glDisable(GL_DEPTH_TEST);
+  resolveShader.use();
+  resolveShader.set(m_visibilitySampler, 0);
+  resolveShader.set(m_vertexSampler, 1);
+  resolveShader.set(m_indexSampler, 2);
+  resolveShader.set(m_meshInfoSampler, 3);
+  resolveShader.set(m_transformSampler, 4);
+  resolveShader.set(m_instanceSampler, 5);
+  resolveShader.set(m_diffuseSampler, 6);
+  resolveShader.set(m_normalSampler, 7);
+  gl_state.BindVertexArray(m_emptyVAO);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glEnable(GL_DEPTH_TEST);
+  m_resolveTimer.End();
+}
@@ -0,0 +1,84 @@
+#ifndef _3D_VIEWER_VISIBILITY_SCHEME_H
+#define _3D_VIEWER_VISIBILITY_SCHEME_H
+
+#include <cstdint>
+#include <vector>
+
+#include "rendering_scheme.h"
+
+/** Visibility-buffer rendering for dense meshes. The geometry pass draws
+ * positions only and writes, per pixel, which triangle of which mesh instance
+ * is visible. A full-screen pass then fetches that triangle's vertices,
+ * interpolates them with barycentrics computed per pixel and shades each
+ * pixel once, so shading no longer pays for the 2x2 quads of tiny triangles.
+ *
+ * Visibility buffer, RG32UI: (mesh + 1) << INSTANCE_BITS | instance, and the
+ * triangle index; 0 marks the background.
+ *
+ * The resolve reads the model from texture buffers, built once per model:
+ *   vertices    RGBA32F, 4 texels per vertex: (position, u), (normal, v),
+ *               (tangent, bitangent sign), color
+ *   indices     R32UI, 3 per triangle, relative to the mesh's first vertex
+ *   meshInfo    RGBA32I, 2 texels per mesh: (first vertex, first index,
+ *               first instance, instance count), (diffuse layer, normal
+ *               layer, Feature mask, 0)
+ *   transforms  RGBA32F, the ObjectUniforms of each mesh
+ *   instances   RGBA32F, the instance transforms of all meshes
+ * and the material textures from two texture arrays, every map resampled to
+ * MAP_SIZE. Only triangle lists are drawn, lit by a light at the camera.
+ */
+class VisibilityBufferScheme : public RenderingScheme {
+ public:
+  static const unsigned int INSTANCE_BITS = 20;  // keep in sync with shaders
+  // meshes past MAX_MESHES or with more instances are not drawn
+  static const unsigned int MAX_MESHES = (1u << (32 - INSTANCE_BITS)) - 1;
+  static const unsigned int MAX_INSTANCES = 1u << INSTANCE_BITS;
+  static const int MAP_SIZE = 1024;
+
+  VisibilityBufferScheme();
+  VisibilityBufferScheme(const SceneModel*, Navigation*);
+  ~VisibilityBufferScheme();
+  virtual void Render() override;
+  virtual TimerList Timers() override {
+    return {{"visibility pass", &m_visibilityTimer},
+            {"resolve", &m_resolveTimer}};
+  }
+
+ private:
+  ShaderVariants visibilityShader;  // only alpha testing needs a variant
+  Shader resolveShader;
+  unsigned int visibilityFBO;
+  unsigned int m_visibility, m_depth;
+  int m_targetWidth, m_targetHeight;
+  unsigned int m_emptyVAO;  // for full-screen triangles
+  // texture buffers and their buffer objects
+  unsigned int m_vertexTex, m_vertexTBO;
+  unsigned int m_indexTex, m_indexTBO;
+  unsigned int m_meshInfoTex, m_meshInfoTBO;
+  unsigned int m_transformTex, m_transformTBO;
+  unsigned int m_instanceTex, m_instanceTBO;
+  unsigned int m_diffuseMaps, m_normalMaps;  // texture arrays
+  // layer of each material in the arrays, -1 for none
+  std::vector<int> m_diffuseLayers, m_normalLayers;
+  unsigned int m_sceneSerial;  // m_modelSerial the buffers belong to
+  std::vector<unsigned char> m_drawable;  // per mesh
+  std::vector<glm::ivec4> m_meshInfo;
+  // uploaded TransformVersion and InstanceVersion of each mesh
+  std::vector<unsigned int> m_transformVersions, m_instanceVersions;
+  UniformHandle<int> m_visibilitySampler, m_vertexSampler, m_indexSampler,
+      m_meshInfoSampler, m_transformSampler, m_instanceSampler,
+      m_diffuseSampler, m_normalSampler;
+  GpuTimer m_visibilityTimer, m_resolveTimer;
+
+  // (re)create the visibility buffer at the viewport size
+  void resizeTargets(int width, int height);
+  void releaseTargets();
+  // vertex, index and material data of the model
+  void buildScene();
+  void buildMaterialMaps();
+  // upload the transforms and instances that changed
+  void updateTransforms();
+  void updateInstances();
+};
+
+#endif  // _3D_VIEWER_VISIBILITY_SCHEME_H
@@ -137,6 +137,22 @@ int main (int argc, char **argv) {
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void *)(3*sizeof(float)));
   glEnableVertexAttribArray(1);
+  // per-instance model matrices, one mat4 attribute = four vec4 columns
+  glm::mat4 models[10];
+  for (unsigned int i = 0; i < 10; ++i) {
+    models[i] = glm::translate(glm::mat4(1.0f), cubePositions[i]);
+    float angle = 20.0f * i;
+    models[i] = glm::rotate(models[i], glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+  }
+  unsigned int instanceVBO;
+  glGenBuffers(1, &instanceVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(models), models, GL_STATIC_DRAW);
+  for (unsigned int c = 0; c < 4; ++c) {
+    glVertexAttribPointer(2 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(c*sizeof(glm::vec4)));
+    glEnableVertexAttribArray(2 + c);
+    glVertexAttribDivisor(2 + c, 1);
+  }
 
   // create textures
   /// texture 1
@@ -207,16 +223,9 @@ int main (int argc, char **argv) {
     shader.setMat4("projection", projection);
     glm::mat4 view = camera.GetViewMatrix();
     shader.setMat4("view", view);
-    // draw boxes
+    // draw boxes, all in one instanced call
     glBindVertexArray(VAO);
-    for (unsigned int i = 0; i < 10; ++i) {
-      glm::mat4 model(1.0f);
-      model = glm::translate(model, cubePositions[i]);
-      float angle = 20.0f * i;
-      model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-      shader.setMat4("model", model);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
-    }
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, 10);
     // swap buffers and poll events
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -224,6 +233,7 @@ int main (int argc, char **argv) {
   // release memory
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &instanceVBO);
   
   // end
   glfwTerminate();
@@ -0,0 +1,133 @@
+// Microbenchmark of the bulk vertex transform in src/3d_viewer against the
+// per-vertex loop it replaced. The kernels are first checked against plain
+// loops; the benchmark fails if they disagree.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+
+#include "vertex_transform.h"
+
+// the former Transform() of model.cpp
+void LegacyTransform(std::vector<glm::vec3> &positions,
+                     std::vector<glm::vec3> &normals, const glm::mat4 &T) {
+  unsigned int N = positions.size();
+  for (unsigned int i = 0; i < N; ++i) {
+    glm::mat3 R(T);
+    normals[i] = R * normals[i];
+    glm::vec4 p(positions[i], 1.0f);
+    p = T * p;
+    positions[i] = glm::vec3(p);
+  }
+}
+
+void BulkTransform(std::vector<glm::vec3> &positions,
+                   std::vector<glm::vec3> &normals, const glm::mat4 &T) {
+  TransformPoints(positions.data(), positions.size(), T);
+  TransformVectors(normals.data(), normals.size(),
+                   glm::transpose(glm::inverse(glm::mat3(T))));
+}
+
+// deterministic values in [-100, 100]
+std::vector<glm::vec3> TestVectors(size_t n, unsigned int seed) {
+  std::vector<glm::vec3> v(n);
+  for (size_t i = 0; i < n; ++i)
+    for (int c = 0; c < 3; ++c) {
+      seed = seed * 1664525u + 1013904223u;
+      v[i][c] = (seed >> 8) * (200.0f / (1 << 24)) - 100.0f;
+    }
+  return v;
+}
+
+// largest difference of a component, relative to the largest expected one
+float MaxError(const glm::vec3 *got, const glm::vec3 *expected, size_t n) {
+  float diff = 0.0f, scale = 1.0f;
+  for (size_t i = 0; i < n; ++i)
+    for (int c = 0; c < 3; ++c) {
+      diff = std::max(diff, std::abs(got[i][c] - expected[i][c]));
+      scale = std::max(scale, std::abs(expected[i][c]));
+    }
+  return diff / scale;
+}
+
+/** compare the kernels with plain loops, on sizes that leave a tail after
+ * the SIMD width and on arrays split across threads; returns the largest
+ * error
+ */
+float CheckKernels(const glm::mat4 &T) {
+  const glm::mat3 M = glm::transpose(glm::inverse(glm::mat3(T)));
+  const size_t sizes[] = {1,  2,  3,    5,    7,          9,
+                          15, 17, 1023, 4099, 65536 + 13, 262144 + 7};
+  float error = 0.0f;
+  for (size_t n : sizes) {
+    std::vector<glm::vec3> points = TestVectors(n, n), expected(n);
+    for (size_t i = 0; i < n; ++i)
+      expected[i] = glm::vec3(T * glm::vec4(points[i], 1.0f));
+    TransformPoints(points.data(), n, T);
+    error = std::max(error, MaxError(points.data(), expected.data(), n));
+
+    std::vector<glm::vec3> vectors = TestVectors(n, n + 1);
+    for (size_t i = 0; i < n; ++i) expected[i] = M * vectors[i];
+    TransformVectors(vectors.data(), n, M);
+    error = std::max(error, MaxError(vectors.data(), expected.data(), n));
+
+    glm::vec3 bounds[2] = {points[0], points[0]};
+    for (size_t i = 1; i < n; ++i) {
+      bounds[0] = glm::min(bounds[0], points[i]);
+      bounds[1] = glm::max(bounds[1], points[i]);
+    }
+    for (bool parallel : {false, true}) {
+      glm::vec3 got[2];
+      ComputeBounds(points.data(), n, got[0], got[1], parallel);
+      error = std::max(error, MaxError(got, bounds, 2));
+    }
+  }
+  return error;
+}
+
+// best of several runs, in milliseconds
+template <typename F>
+double Time(F transform, std::vector<glm::vec3> &positions,
+            std::vector<glm::vec3> &normals, const glm::mat4 &T) {
+  double best = 1e30;
+  for (int run = 0; run < 10; ++run) {
+    auto t0 = std::chrono::steady_clock::now();
+    transform(positions, normals, T);
+    auto t1 = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    if (ms < best) best = ms;
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  // a rotation close to the identity keeps values bounded over the runs
+  glm::mat4 T = glm::rotate(glm::mat4(1.0f), 0.01f, glm::vec3(0, 1, 0));
+  std::cout << "kernel: " << TransformKernelName() << std::endl;
+  // a general affine map, so that every matrix entry matters
+  glm::mat4 A = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, -2.0f, 5.0f));
+  A = glm::rotate(A, 0.7f, glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f)));
+  A = glm::scale(A, glm::vec3(2.0f, 0.5f, 3.0f));
+  const float error = CheckKernels(A);
+  std::cout << "max relative error: " << error << std::endl;
+  if (!(error <= 1e-5f)) {
+    std::cerr << "the kernels disagree with the scalar loops" << std::endl;
+    return 1;
+  }
+  std::cout << "vertices\tlegacy ms\tbulk ms\tspeedup" << std::endl;
+  for (size_t n = 1 << 10; n <= (1 << 22); n <<= 2) {
+    std::vector<glm::vec3> positions(n), normals(n);
+    for (size_t i = 0; i < n; ++i) {
+      positions[i] = glm::vec3(i % 101, i % 37, i % 11);
+      normals[i] = glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+    double legacy = Time(LegacyTransform, positions, normals, T);
+    double bulk = Time(BulkTransform, positions, normals, T);
+    std::cout << n << "\t" << legacy << "\t" << bulk << "\t" << legacy / bulk
+              << std::endl;
+  }
+  return 0;
+}